@@ -22,47 +22,133 @@
 #include <config.h>
 #include "attr.h"
 #include "hashtable.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
  /* atoms contains the atoms that are the names of the attributes */
 static struct hashtable *atoms = 0;
+ /* atomlock guards atoms, pages may be parsed by several threads */
+static pthread_rwlock_t atomlock = PTHREAD_RWLOCK_INITIALIZER;
+
+ /*
+  * struct Attr
+  *  an attribute of the current tag, if generation is that of its table
+  */
+struct Attr {
+    struct Atom *atom;
+    char *value;
+    unsigned generation;
+};
+
+#define ATTRS_SIZE 16		/* slots of a new table, more than a tag has */
+
+ /*
+  * struct Attrs
+  *  values of the attributes of the current parsed tag, open addressed by
+  *  atom (a uniqued string). a slot is in use only if it has the generation
+  *  of the table, so attr_reset clears the table by starting a new one
+  */
+struct Attrs {
+    struct Attr *slots;
+    int size;			/* a power of two */
+    int count;			/* attributes of this generation */
+    unsigned generation;
+};
+
  /*
-  * attrs contains values of the attributes of the current parsed tag 
-  * Each key is an atom (a uniqued string)
+  * attr_create
+  *  create a table for the attribute name/value pairs of a tag
   */
-static struct hashtable *attrs = 0;
+struct Attrs *attr_create() {
+    struct Attrs *attrs = malloc(sizeof(struct Attrs));
+    attrs->slots = calloc(ATTRS_SIZE, sizeof(struct Attr));
+    attrs->size = ATTRS_SIZE;
+    attrs->count = 0;
+    attrs->generation = 1;
+    return attrs;
+}
 
  /*
-  * attr_init
-  *  init all the statics
+  * attr_free
+  *  frees an attribute table
   */
-static void attr_init() {
-    atoms = hashtable_string_create(47);
-    attrs = hashtable_create(47);
-    hashtable_set_keys_are_pointers(attrs);
+void attr_free(struct Attrs *attrs) {
+    if (!attrs)
+	return;
+    free(attrs->slots);
+    free(attrs);
 }
 
  /*
   * attr_reset
-  *  clear out the current attribute name/value pairs
+  *  clear out the current attribute name/value pairs, in constant time.
+  *  the slots are only zeroed when the generation wraps around
   */
-void attr_reset() {
-    if (!atoms)
-	attr_init();
-    hashtable_clean(attrs);
+void attr_reset(struct Attrs *attrs) {
+    if (!++attrs->generation) {
+	memset(attrs->slots, 0, attrs->size * sizeof(struct Attr));
+	attrs->generation = 1;
+    }
+    attrs->count = 0;
+}
+
+ /*
+  * findslot
+  *  returns the slot of atom, or the free slot where it goes
+  */
+static struct Attr *findslot(struct Attr *slots, int size, unsigned generation, struct Atom *atom) {
+    unsigned mask = size - 1;
+    unsigned i = (unsigned)(((unsigned long long)(size_t)atom * 0x9e3779b97f4a7c15ULL) >> 32);
+    for (;; i++) {
+	struct Attr *slot = slots + (i & mask);
+	if (slot->generation != generation || slot->atom == atom)
+	    return slot;
+    }
+}
+
+ /*
+  * grow
+  *  double the slots of attrs, keeping the attributes of this generation.
+  *  returns -1 if out of memory
+  */
+static int grow(struct Attrs *attrs) {
+    int i, size = attrs->size * 2;
+    struct Attr *slots = calloc(size, sizeof(struct Attr));
+    if (!slots)
+	return -1;
+    for (i = 0; i < attrs->size; i++) {
+	struct Attr *cur = attrs->slots + i;
+	if (cur->generation == attrs->generation)
+	    *findslot(slots, size, attrs->generation, cur->atom) = *cur;
+    }
+    free(attrs->slots);
+    attrs->slots = slots;
+    attrs->size = size;
+    return 0;
 }
 
  /*
   * attr_atom
-  *  create an atom or unique string
+  *  create an atom or unique string. Lookups of existing atoms only take
+  *  the read lock.
   */
 struct Atom *attr_atom(char *key) {
-    struct Atom *val;
+    struct Atom *val = NULL;
+    pthread_rwlock_rdlock(&atomlock);
+    if (atoms)
+	val = (struct Atom *) hashtable_get(atoms, key);
+    pthread_rwlock_unlock(&atomlock);
+    if (val)
+	return val;
+    pthread_rwlock_wrlock(&atomlock);
     if (!atoms)
-	attr_init();
+	atoms = hashtable_string_create(47);
     val = (struct Atom *) hashtable_get(atoms, key);
     if (!val) {
 	hashtable_put(atoms, key, key);
 	val = (struct Atom *) hashtable_get(atoms, key);
     }
+    pthread_rwlock_unlock(&atomlock);
     return val;
 }
 
@@ -70,17 +156,27 @@ struct Atom *attr_atom(char *key) {
   * attr_put
   *  store an attribute name/value pair
   */
-void attr_put(char *key, char *value) {
+void attr_put(struct Attrs *attrs, char *key, char *value) {
     struct Atom *atom = attr_atom(key);
-    hashtable_put(attrs, (void *)atom, value);
+    struct Attr *slot = findslot(attrs->slots, attrs->size, attrs->generation, atom);
+    if (slot->generation != attrs->generation) {
+	if (4 * (attrs->count + 1) > 3 * attrs->size) {
+	    if (grow(attrs))
+		return;
+	    slot = findslot(attrs->slots, attrs->size, attrs->generation, atom);
+	}
+	slot->atom = atom;
+	slot->generation = attrs->generation;
+	attrs->count++;
+    }
+    slot->value = value;
 }
 
  /*
   * attr_get
   *  get a value for attribute atom (must be called with atoms)
   */
-char *attr_get(struct Atom *atom) {
-    if (!atoms)
-	attr_init();
-    return (char *) hashtable_get(attrs, (void *)atom);
+char *attr_get(struct Attrs *attrs, struct Atom *atom) {
+    struct Attr *slot = findslot(attrs->slots, attrs->size, attrs->generation, atom);
+    return (slot->generation == attrs->generation) ? slot->value : NULL;
 }
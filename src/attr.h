@@ -24,25 +24,37 @@
 #define INCLUDED_ATTR_H
 
 struct Atom;
+struct Attrs;
 
+ /*
+  * attr_create
+  *  create a table for the attribute name/value pairs of a tag. Each parser
+  *  (thread) has its own table.
+  */
+struct Attrs *attr_create();
+ /*
+  * attr_free
+  *  frees an attribute table
+  */
+void attr_free(struct Attrs *attrs);
  /*
   * attr_reset
-  *  clear out the current attribute name/value pairs
+  *  clear out the current attribute name/value pairs, in constant time
   */
-void attr_reset();
+void attr_reset(struct Attrs *attrs);
  /*
   * attr_put
   *  store an attribute name/value pair
   */
-void attr_put(char *key, char *value);
+void attr_put(struct Attrs *attrs, char *key, char *value);
  /*
   * attr_get
   *  get a value for attribute atom (must be called with atoms)
   */
-char *attr_get(struct Atom *atom);
+char *attr_get(struct Attrs *attrs, struct Atom *atom);
  /*
   * attr_atom
-  *  create an atom or unique string
+  *  create an atom or unique string, safe to call from several threads
   */
 struct Atom *attr_atom(char *key);
 
@@ -0,0 +1,75 @@
+/*
+ * doc.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include "doc.h"
+#include "font.h"
+#include "html.h"
+#include "page.h"
+#include "parse.h"
+#include "histogram.h"
+
+ /*
+  * doc_create
+  *  create an empty document
+  */
+struct Doc *doc_create() {
+    struct Doc *doc = calloc(1, sizeof(struct Doc));
+    if (!doc)
+	return NULL;
+    doc->threads = 1;
+    doc->fonts = font_create();
+    doc->page_delta = -1;
+    doc->page_first = -1;
+    doc->page_last = -1;
+    doc->page_mintop = -1;
+    doc->page_maxtop = -1;
+    doc->page_lineheight = 15;
+    doc->page_lineleading = -1;
+    doc->page_center = -1;
+    doc->page_indentleft = -1;
+    doc->page_outdentleft = -1;
+    doc->page_prevstyle = -1;
+    return doc;
+}
+
+ /*
+  * doc_free
+  *  frees a document, its pages, fonts, styles and layout
+  */
+void doc_free(struct Doc *doc) {
+    if (!doc)
+	return;
+    if (doc->layout) {
+	histogram_free(doc->layout->left);
+	histogram_free(doc->layout->right);
+	histogram_free(doc->layout->fontsize);
+	histogram_free(doc->layout->lineheight);
+	histogram_free(doc->layout->leading);
+	free(doc->layout);
+    }
+    parse_free(doc);
+    page_freeranges(doc);
+    html_free(doc);
+    font_free(doc->fonts);
+    free(doc);
+}
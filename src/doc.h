@@ -0,0 +1,98 @@
+/*
+ * doc.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_DOC_H
+#define INCLUDED_DOC_H
+struct array;
+struct hashtable;
+struct Input;
+struct Fonts;
+struct FontDesc;
+struct Layout;
+struct Stats;
+struct Sink;
+
+ /*
+  * Doc
+  *  the state of one document being reflowed. each module keeps its document
+  *  state here instead of in statics, so several documents can be converted at
+  *  once. atoms (attr.c) are shared by all documents.
+  */
+struct Doc {
+    /* parse.c */
+    char *encoding;			/* encoding of the xml document */
+    struct array *pages;		/* the parsed pages */
+    struct Input *input;		/* the input, text objects point into it */
+    int threads;			/* number of threads parsing pages */
+    int *fontlines;			/* line where each font was first defined */
+    int fontlinecount;			/* length of fontlines */
+
+    /* font.c */
+    struct Fonts *fonts;		/* the fontspecs of the document */
+
+    /* page.c */
+    int page_delta;			/* diff between real and printed page number */
+    int page_first;			/* first page with a detected page number */
+    int page_last;			/* last page with a detected page number */
+    int page_mintop;			/* min y position used for cropping */
+    int page_maxtop;			/* max y position used for cropping */
+    int page_rag;			/* paragraphs contain rag-right text (vs justified) */
+    int page_lineheight;		/* ordinary line height, most used in document */
+    int page_lineleading;		/* ordinary line leading, most used in document */
+    int page_showpara;			/* show debugging paragraph info */
+    struct array *pageranges;		/* used for --dontreflow option */
+    int page_center;			/* x center of centered lines, -1 if unknown */
+    int page_nonfiction;		/* text does not have a lot of dialog */
+    int page_shortlines;		/* percent of width of a short line */
+    int page_indentleft;		/* x position of an indent (only 1 per doc) */
+    int page_outdentleft;		/* x position of an outdent (2nd line of paragraph) */
+    int page_prevstyle;			/* style of previous paragraph */
+
+    /* html.c */
+    struct hashtable *html_styles;	/* unique paragraph styles */
+    struct hashtable *html_fonts;	/* unique fonts */
+    int html_counters[10];		/* number of styles of each element */
+    int html_curfontid;			/* id of the last font */
+    int html_showstyle;			/* print debugging info when styles are created */
+    int html_absfontsize;		/* absolute font sizes */
+    int html_rag;			/* text is rag right */
+    int html_musthave;
+    struct FontDesc *html_defaultfont;	/* most used font */
+
+    /* reflow.c */
+    struct Layout *layout;		/* frequency tables, filled once */
+    struct Stats *stats;		/* phase timings, NULL unless --stats */
+    struct Sink *diag;			/* debug reports, flushed after each phase */
+};
+
+ /*
+  * doc_create
+  *  create an empty document
+  */
+struct Doc *doc_create();
+
+ /*
+  * doc_free
+  *  frees a document, its pages, fonts, styles and layout
+  */
+void doc_free(struct Doc *doc);
+
+#endif /* INCLUDED_DOC_H */
@@ -22,75 +22,182 @@
 #include <config.h>
 
 #include "attr.h"
+#include "doc.h"
 #include "font.h"
 #include "hashtable.h"
 #include "array.h"
+#include "sink.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
-static struct hashtable *fonts = 0;
-static struct hashtable *font_printstrs = 0;
+ /*
+  * fonts are kept in blocks that never move, so the font of a text can be
+  * read while another thread adds an unknown id. newindex fills in the slot
+  * and block pointer before it publishes the new fontcount with a release
+  * store, and font_get reads the count with an acquire load, so a reader never
+  * sees an index whose block is not there yet. The index of a font is its
+  * numeric id for pdftohtml output, the ids are 0, 1, 2...
+  */
+#define FONT_BLOCKSIZE 256
+#define FONT_BLOCKS 4096
+#define FONT_MAXID (FONT_BLOCKSIZE * FONT_BLOCKS)
+
+struct Fonts {
+    struct Font *fontblocks[FONT_BLOCKS];
+    int fontcount;			/* number of font indexes in use, atomic */
+    int *idindexes;			/* numeric id -> index + 1 */
+    int idcount;			/* length of idindexes */
+    struct hashtable *otherids;		/* other ids (atoms) -> index + 1 */
+    struct hashtable *font_printstrs;	/* printstr -> index + 1 of first font */
+    pthread_mutex_t fontlock;
+};
 
 struct Font {
     struct Atom *id;		/* id from xml */
+    int defined;		/* 1 once the fontspec has been seen */
     int size;			/* font size */
     struct Atom *family;	/* family name */
     struct Atom *color;		/* font color */
     struct Atom *printstr;	/* debugging print string, ie Times-10 */
+    int printindex;		/* index of the first font with the same printstr */
 };
 
+ /*
+  * font_create
+  *  create an empty font table
+  */
+struct Fonts *font_create() {
+    struct Fonts *fonts = calloc(1, sizeof(struct Fonts));
+    if (fonts)
+	pthread_mutex_init(&fonts->fontlock, NULL);
+    return fonts;
+}
+
  /*
   * font_free
-  *  frees a font object
+  *  frees a font table
   */
-static void font_free(struct hashtable *table, void *value, void *context) {
-    struct Font *font = value;
-    free(font);    
+void font_free(struct Fonts *fonts) {
+    int i;
+    if (!fonts)
+	return;
+    for (i = 0; i < FONT_BLOCKS && fonts->fontblocks[i]; i++)
+	free(fonts->fontblocks[i]);
+    free(fonts->idindexes);
+    if (fonts->otherids)
+	hashtable_free(fonts->otherids);
+    if (fonts->font_printstrs)
+	hashtable_free(fonts->font_printstrs);
+    pthread_mutex_destroy(&fonts->fontlock);
+    free(fonts);
 }
 
  /*
-  * font_procs
-  *  callback procs for hashtable
+  * font_get
+  *  get a defined font object from its index
   */
-struct hashtable_procs font_procs = {
-    font_free
-};
+static struct Font *font_get(struct Fonts *fonts, int index) {
+    struct Font *font;
+    if (index < 0 || index >= __atomic_load_n(&fonts->fontcount, __ATOMIC_ACQUIRE))
+	return NULL;
+    font = fonts->fontblocks[index / FONT_BLOCKSIZE] + (index % FONT_BLOCKSIZE);
+    return font->defined ? font : NULL;
+}
 
  /*
-  * font_init
-  *  create some static tables - fonts, font_printstrs
+  * numericid
+  *  returns the value of an id that is a small decimal number, or -1
   */
-static void font_init() {
-    fonts = hashtable_special_create(0, &font_procs, NULL);
-    hashtable_set_keys_are_pointers(fonts);
-    font_printstrs = hashtable_create(0);
-    hashtable_set_keys_are_pointers(font_printstrs);
+static int numericid(char *id) {
+    int val = 0;
+    if (!*id || (*id == '0' && id[1]))
+	return -1;
+    for (; *id; id++) {
+	if (*id < '0' || *id > '9' || val >= (FONT_MAXID / 10))
+	    return -1;
+	val = (val * 10) + (*id - '0');
+    }
+    return val;
 }
 
  /*
-  * font_get
-  *  get a font object from its id
+  * newindex
+  *  allocates a font index for id, must hold fontlock. readers do not take
+  *  the lock, so the count is stored last
   */
-static struct Font *font_get(struct Atom *id) {
-    if (!fonts)
-	return NULL;
-    return hashtable_get(fonts, (void *)id);
+static int newindex(struct Fonts *fonts, char *id) {
+    int index = fonts->fontcount;
+    struct Font *block;
+    if (index >= FONT_MAXID)
+	return -1;
+    block = fonts->fontblocks[index / FONT_BLOCKSIZE];
+    if (!block) {
+	block = calloc(FONT_BLOCKSIZE, sizeof(struct Font));
+	fonts->fontblocks[index / FONT_BLOCKSIZE] = block;
+    }
+    block[index % FONT_BLOCKSIZE].id = attr_atom(id);
+    __atomic_store_n(&fonts->fontcount, index + 1, __ATOMIC_RELEASE);
+    return index;
+}
+
+ /*
+  * font_index
+  *  returns the index of a font id, a font that has not been added yet
+  *  gets an index too, so that it can be added later. -1 if id is NULL.
+  */
+int font_index(struct Doc *doc, char *id) {
+    struct Fonts *fonts = doc->fonts;
+    int num, index = -1;
+    if (!id)
+	return -1;
+    num = numericid(id);
+    pthread_mutex_lock(&fonts->fontlock);
+    if (num >= 0) {
+	if (num >= fonts->idcount) {
+	    int count = fonts->idcount ? fonts->idcount : 64;
+	    while (count <= num)
+		count *= 2;
+	    fonts->idindexes = realloc(fonts->idindexes, count * sizeof(int));
+	    memset(fonts->idindexes + fonts->idcount, 0, (count - fonts->idcount) * sizeof(int));
+	    fonts->idcount = count;
+	}
+	index = fonts->idindexes[num] - 1;
+	if (index < 0) {
+	    index = newindex(fonts, id);
+	    fonts->idindexes[num] = index + 1;
+	}
+    } else {
+	struct Atom *atom = attr_atom(id);
+	if (!fonts->otherids) {
+	    fonts->otherids = hashtable_create(0);
+	    hashtable_set_keys_are_pointers(fonts->otherids);
+	}
+	index = (int)(long)hashtable_get(fonts->otherids, (void *)atom) - 1;
+	if (index < 0) {
+	    index = newindex(fonts, id);
+	    hashtable_put(fonts->otherids, (void *)atom, (void *)(long)(index + 1));
+	}
+    }
+    pthread_mutex_unlock(&fonts->fontlock);
+    return index;
 }
 
  /*
   * font_size
-  *  returns the size of a font, the id of the font is an atom
+  *  returns the size of a font, -1 if not defined
   */
-int font_size(struct Atom *id) {
-    struct Font *font = font_get(id);
+int font_size(struct Doc *doc, int index) {
+    struct Font *font = font_get(doc->fonts, index);
     if (font) {
 	return font->size;
     }
     return -1;
 }
 
-struct Atom *font_printstr(struct Atom *id) {
-    struct Font *font = font_get(id);
+struct Atom *font_printstr(struct Doc *doc, int index) {
+    struct Font *font = font_get(doc->fonts, index);
     if (font) {
 	return font->printstr;
     }
@@ -99,10 +206,10 @@ struct Atom *font_printstr(struct Atom *id) {
 
  /*
   * font_family
-  *  returns the family of a font, the id of the font is an atom
+  *  returns the family of a font, NULL if not defined
   */
-char *font_family(struct Atom *id) {
-    struct Font *font = font_get(id);
+char *font_family(struct Doc *doc, int index) {
+    struct Font *font = font_get(doc->fonts, index);
     if (font) {
 	return (char *)font->family;
     }
@@ -111,30 +218,57 @@ char *font_family(struct Atom *id) {
 
  /*
   * font_add
-  *  Add a font to the global table
+  *  Add a font to the table of the document, a font that is added again is replaced.
+  *  returns 1 if the size of a font that was already added changed
   */
-void font_add(char *id, int size, char *family, char *color) {
+int font_add(struct Doc *doc, char *id, int size, char *family, char *color) {
+    struct Fonts *fonts = doc->fonts;
     struct Font *font;
     char buf[100];
-    if (!fonts)
-	font_init();
-    font = (struct Font *)malloc(sizeof(struct Font));
-    font->id = attr_atom(id);
+    int index = font_index(doc, id);
+    int changed;
+    if (index < 0)
+	return 0;
+    font = fonts->fontblocks[index / FONT_BLOCKSIZE] + (index % FONT_BLOCKSIZE);
+    changed = font->defined && font->size != size;
     font->size = size;
     font->family = attr_atom(family);
     font->color = attr_atom(color);
     snprintf(buf, sizeof(buf), "%s-%d", family, font->size);
     font->printstr = attr_atom(buf);
-    hashtable_put(fonts, (void *) font->id, font);
-    if (!hashtable_get(font_printstrs, (void *)font->printstr))
-	hashtable_put(font_printstrs, (void *)font->printstr, font);
+    font->defined = 1;
+    if (!fonts->font_printstrs) {
+	fonts->font_printstrs = hashtable_create(0);
+	hashtable_set_keys_are_pointers(fonts->font_printstrs);
+    }
+    if (!hashtable_get(fonts->font_printstrs, (void *)font->printstr))
+	hashtable_put(fonts->font_printstrs, (void *)font->printstr, (void *)(long)(index + 1));
+    font->printindex = font_fromprintstr(doc, font->printstr);
+    return changed;
 }
 
-struct Atom *font_fromprintstr(struct Atom *printstr) {
-    struct Font *font = hashtable_get(font_printstrs, (void *)printstr);
-    if (!font)
-	return NULL;
-    return font->id;
+ /*
+  * font_printindex
+  *  returns the index of the first font with the same printstr as a font, or -1
+  *  if not defined. fonts that print the same share this index
+  */
+int font_printindex(struct Doc *doc, int index) {
+    struct Font *font = font_get(doc->fonts, index);
+    if (font) {
+	return font->printindex;
+    }
+    return -1;
+}
+
+ /*
+  * font_fromprintstr
+  *  returns the index of the first font added with printstr, or -1
+  */
+int font_fromprintstr(struct Doc *doc, struct Atom *printstr) {
+    struct Fonts *fonts = doc->fonts;
+    if (!fonts->font_printstrs)
+	return -1;
+    return (int)(long)hashtable_get(fonts->font_printstrs, (void *)printstr) - 1;
 }
 
  /*
@@ -156,21 +290,21 @@ fontcompare(const void *p1, const void *p2) {
   * font_printfonts
   *  print all the fonts in the document
   */
-void font_printfonts() {
+void font_printfonts(struct Doc *doc) {
+    struct Fonts *fonts = doc->fonts;
     struct array *keys;
     struct hashtable *inversion;
     int i, length;
     struct array *values = 0;
-    if (!fonts)
+    if (!fonts->fontcount)
 	return;
-    keys = hashtable_keys(fonts, 0);
-    length = array_length(keys);
     inversion = hashtable_create(0);
-    for (i = 0; i < length; i++) {
-	char *id = array_elementat(keys, i);
-	struct Font *font = hashtable_get(fonts, id);
-	void *family = (void *)font->family;
-	
+    for (i = 0; i < fonts->fontcount; i++) {
+	struct Font *font = font_get(fonts, i);
+	void *family;
+	if (!font)
+	    continue;
+	family = (void *)font->family;
 	values = hashtable_get(inversion, family);
 	if (!values) {
 	    values = array_pointer_init(0);
@@ -178,7 +312,6 @@ void font_printfonts() {
 	}
 	array_append_element(values, font);
     }
-    array_free(keys);
     keys = hashtable_keys(inversion, 0);
     array_sortstrings(keys, 1, 1);
     length = array_length(keys);
@@ -187,7 +320,7 @@ void font_printfonts() {
 	int j, vlen;
 	int lastsize = -1;
 	values = hashtable_get(inversion, family);
-	fprintf(stderr, "%s: ", family);
+	sink_printf(doc->diag, "%s: ", family);
 	vlen = array_length(values);
 	array_set_contains_pointers(values, 0);
 	qsort(array_elementat(values, 0), vlen, sizeof(char *), fontcompare);
@@ -197,13 +330,12 @@ void font_printfonts() {
 	    if (font->size == lastsize)
 		continue;
 	    if (j)
-		fprintf(stderr, ", ");
-	    fprintf(stderr, "%d", font->size);
+		sink_puts(doc->diag, ", ");
+	    sink_putint(doc->diag, font->size);
 	    lastsize = font->size;
 	}
-	fprintf(stderr, "\n");
+	sink_putc(doc->diag, '\n');
 	array_free(values);
     }
     hashtable_free(inversion);
 }
-
@@ -23,30 +23,57 @@
 #ifndef INCLUDED_FONT_H
 #define INCLUDED_FONT_H
 struct Atom;
+struct Doc;
+struct Fonts;
 
+ /*
+  * font_create
+  *  create an empty font table, one per document
+  */
+struct Fonts *font_create();
+
+ /*
+  * font_free
+  *  frees a font table
+  */
+void font_free(struct Fonts *fonts);
+
+ /*
+  * font_index
+  *  returns the small index of a font id (thread safe), fonts that are not
+  *  added yet get one too. Returns -1 if id is NULL.
+  */
+int font_index(struct Doc *doc, char *id);
  /*
   * font_add
-  *  Add a font to the global table.
+  *  Add a font to the table of the document. returns 1 if the size of a font
+  *  that was already added changed
   */
-void font_add(char *id, int size, char *family, char *color);
+int font_add(struct Doc *doc, char *id, int size, char *family, char *color);
  /*
   * font_size
-  *  returns the size of a font, the id of the font is an atom
+  *  returns the size of a font, -1 if the font was not added
   */
-int font_size(struct Atom *id);
+int font_size(struct Doc *doc, int index);
  /*
   * font_family
-  *  returns the family of a font, the id of the font is an atom
+  *  returns the family of a font, NULL if the font was not added
   */
-char *font_family(struct Atom *id);
+char *font_family(struct Doc *doc, int index);
 
  /*
   * font_printfonts
   *  print all the fonts in the document
   */
-void font_printfonts();
+void font_printfonts(struct Doc *doc);
+
+struct Atom *font_printstr(struct Doc *doc, int index);
+int font_fromprintstr(struct Doc *doc, struct Atom *printstr);
 
-struct Atom *font_printstr(struct Atom *id);
-struct Atom *font_fromprintstr(struct Atom *printstr);
+ /*
+  * font_printindex
+  *  returns the index of the first font with the same printstr as a font, or -1
+  */
+int font_printindex(struct Doc *doc, int index);
 
 #endif /* INCLUDED_FONT_H */
@@ -0,0 +1,375 @@
+/*
+ * genpdf2xml.c
+ *
+ * Copyright (C) 2010 Pranananda Deva
+ *
+ * This file is part of pdfreflow.
+ *
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * genpdf2xml writes a made up book as pdf2xml to standard out, to time
+  * pdfreflow on documents much larger than those in test/. the same options
+  * and seed always give the same document, on any machine.
+  */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#define PAGEWIDTH 612
+#define PAGEHEIGHT 792
+#define MARGIN 72		/* of all four sides */
+#define LINEHEIGHT 12		/* top to top of body lines */
+#define CHARWIDTH 5		/* average width of a body character */
+#define LINECHARS ((PAGEWIDTH - 2 * MARGIN) / CHARWIDTH)
+#define MAXTEXTS 32		/* texts a line can be split into */
+
+ /*
+  * fonts
+  *  the fontspecs of the document. the first three are always used, --fonts
+  *  adds the others to the mix of the body text
+  */
+static struct {
+    const char *family;
+    int size;
+} fonts[] = {
+    { "Times", 10 },		/* body */
+    { "Times-Bold", 16 },	/* chapter headings */
+    { "Times", 8 },		/* running headers and footers */
+    { "Times-Italic", 10 },
+    { "Helvetica", 10 },
+    { "Courier", 9 },
+    { "Palatino", 10 },
+    { "Garamond", 11 }
+};
+#define BODYFONT 0
+#define HEADINGFONT 1
+#define RUNNINGFONT 2
+#define MIXFONT 3		/* first font of the mix */
+#define MAXFONTS ((int)(sizeof(fonts) / sizeof(fonts[0])) - MIXFONT + 1)
+
+static const char *words[] = {
+    "the", "of", "and", "a", "to", "in", "is", "you", "that", "it", "he",
+    "was", "for", "on", "are", "as", "with", "his", "they", "I", "at", "be",
+    "this", "have", "from", "or", "one", "had", "by", "word", "but", "not",
+    "what", "all", "were", "we", "when", "your", "can", "said", "there",
+    "mind", "self", "awareness", "consciousness", "understanding",
+    "experience", "reflection", "nevertheless", "whatever", "knowledge",
+    "meditation", "silence", "attention", "presence", "everything",
+    "&amp;", "beginning", "question", "teaching", "absolute", "nothing"
+};
+#define WORDS ((int)(sizeof(words) / sizeof(words[0])))
+#define LONGWORD 9		/* words at least this long may be hyphenated */
+
+ /*
+  * Options
+  *  the shape of the generated book
+  */
+static struct Options {
+    unsigned long long seed;
+    int pages;
+    int lines;			/* body lines per page */
+    int texts;			/* texts each body line is split into */
+    int fonts;			/* fonts in the mix of the body text */
+    int indent;			/* first line indent of paragraphs, 0 for none */
+    int chapters;		/* pages per chapter, 0 for no chapters */
+    int running;		/* running headers and page numbers */
+    int hyphens;		/* percent of lines ending in a hyphenated word */
+} options = { 1, 100, 50, 1, 2, 18, 20, 1, 5 };
+
+ /*
+  * Book
+  *  the state carried from line to line and page to page
+  */
+static struct Book {
+    unsigned long long random;	/* state of the random numbers */
+    int paralines;		/* lines left in the current paragraph */
+    char carry[32];		/* rest of a hyphenated word, starts the next line */
+    int chapter;
+    long texts;			/* texts written */
+} book;
+
+ /*
+  * nextrandom
+  *  returns the next random number of the book, splitmix64
+  */
+static unsigned int nextrandom() {
+    unsigned long long z = (book.random += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (unsigned int)((z ^ (z >> 31)) >> 32);
+}
+
+ /*
+  * below
+  *  returns a random number from 0 to n - 1
+  */
+static int below(int n) {
+    return nextrandom() % n;
+}
+
+ /*
+  * printtext
+  *  print a text element, the width is estimated from the length of str
+  */
+static void printtext(int top, int left, int font, const char *str, int length) {
+    int chars = length;
+    const char *amp;
+    for (amp = str; (amp = memchr(amp, '&', str + length - amp)); amp++)
+	chars -= 4;
+    printf("<text top=\"%d\" left=\"%d\" width=\"%d\" height=\"%d\" font=\"%d\">%.*s</text>\n",
+	top, left, chars * fonts[font].size / 2, fonts[font].size + 4, font, length, str);
+    book.texts++;
+}
+
+ /*
+  * printcentered
+  *  print str centered on the page
+  */
+static void printcentered(int top, int font, const char *str) {
+    int width = strlen(str) * fonts[font].size / 2;
+    printtext(top, (PAGEWIDTH - width) / 2, font, str, strlen(str));
+}
+
+ /*
+  * mixfont
+  *  returns the font of a body text, mostly the body font
+  */
+static int mixfont() {
+    if (options.fonts < 2 || below(100) < 85)
+	return BODYFONT;
+    return MIXFONT + below(options.fonts - 1);
+}
+
+ /*
+  * fillline
+  *  fill line with words up to length characters. the last word may be
+  *  hyphenated, with its rest kept for the next line. returns the length
+  */
+static int fillline(char *line, int length, int hyphenate) {
+    int used = 0;
+    int limit = hyphenate ? length - 4 : length;	/* room for a piece of a word */
+    if (book.carry[0]) {
+	used = sprintf(line, "%s ", book.carry);
+	book.carry[0] = 0;
+    }
+    for (;;) {
+	const char *word = words[below(WORDS)];
+	int wordlen = strlen(word);
+	if (used + wordlen + 1 <= limit) {
+	    used += sprintf(line + used, "%s ", word);
+	    continue;
+	}
+	while (hyphenate && wordlen < LONGWORD) {
+	    word = words[below(WORDS)];
+	    wordlen = strlen(word);
+	}
+	/* split the word where the line ends, keeping two letters on each side */
+	if (hyphenate) {
+	    int split = length - used - 1;
+	    if (split > wordlen - 2)
+		split = wordlen - 2;
+	    used += sprintf(line + used, "%.*s-", split, word);
+	    strcpy(book.carry, word + split);
+	}
+	return used;
+    }
+}
+
+ /*
+  * printline
+  *  print a body line split into texts at word boundaries
+  */
+static void printline(int top, int left, char *line, int length) {
+    int i, start = 0, texts = options.texts;
+    for (i = 0; i < texts && start < length; i++) {
+	/* the end of this text, after a space past its share of the line */
+	int end = (i == texts - 1) ? length : length * (i + 1) / texts;
+	if (end <= start)
+	    end = start + 1;
+	while (end < length && line[end - 1] != ' ')
+	    end++;
+	printtext(top, left + start * CHARWIDTH, mixfont(), line + start, end - start);
+	start = end;
+    }
+}
+
+ /*
+  * printbody
+  *  print the paragraphs of a page, from top down
+  */
+static void printbody(int top, int lines) {
+    char line[LINECHARS + sizeof(book.carry) + 2];
+    int i;
+    for (i = 0; i < lines; i++, top += LINEHEIGHT) {
+	int left = MARGIN, length = LINECHARS;
+	int hyphenate;
+	if (!book.paralines) {
+	    book.paralines = 2 + below(9);
+	    left += options.indent;
+	    length -= options.indent / CHARWIDTH;
+	}
+	book.paralines--;
+	/* the last line of a paragraph is short, and not hyphenated */
+	if (!book.paralines)
+	    length = length * (30 + below(50)) / 100;
+	hyphenate = book.paralines && below(100) < options.hyphens;
+	length = fillline(line, length, hyphenate);
+	printline(top, left, line, length);
+	/* without an indent paragraphs are apart */
+	if (!book.paralines && !options.indent)
+	    top += LINEHEIGHT / 2;
+    }
+}
+
+ /*
+  * printpage
+  *  print page number of the book
+  */
+static void printpage(int number) {
+    char str[64];
+    int top = MARGIN, lines = options.lines;
+    int i;
+
+    printf("<page number=\"%d\" position=\"absolute\" top=\"0\" left=\"0\" height=\"%d\" width=\"%d\">\n",
+	number, PAGEHEIGHT, PAGEWIDTH);
+    if (number == 1) {
+	for (i = 0; i < MIXFONT + options.fonts - 1; i++)
+	    printf("\t<fontspec id=\"%d\" size=\"%d\" family=\"%s\" color=\"#000000\"/>\n",
+		i, fonts[i].size, fonts[i].family);
+    }
+    if (options.chapters && (number - 1) % options.chapters == 0) {
+	book.chapter++;
+	sprintf(str, "Chapter %d", book.chapter);
+	printcentered(top, HEADINGFONT, str);
+	top += 4 * LINEHEIGHT;
+	lines -= 4;
+	book.paralines = 0;
+	book.carry[0] = 0;
+    } else if (options.running) {
+	if (number % 2)
+	    sprintf(str, "Chapter %d", book.chapter);
+	else
+	    strcpy(str, "A Synthetic Book");
+	printcentered(MARGIN / 2, RUNNINGFONT, str);
+    }
+    if (lines > 0)
+	printbody(top, lines);
+    if (options.running) {
+	sprintf(str, "%d", number);
+	printcentered(PAGEHEIGHT - MARGIN / 2, RUNNINGFONT, str);
+    }
+    printf("</page>\n");
+}
+
+static void usage(int retval) {
+    fprintf(stderr, "\n\
+usage: genpdf2xml [options] > book.xml\n\
+Options:\n\
+  -s, --seed=N		seed of the random text (default is 1)\n\
+  -p, --pages=N		number of pages (default is 100)\n\
+  -l, --lines=N		body lines per page (default is 50)\n\
+  -t, --texts=N		texts each line is split into (default is 1)\n\
+  -f, --fonts=N		fonts in the body text, 1 to %d (default is 2)\n\
+  -i, --indent=N	paragraph indent, 0 for spaced paragraphs (default is 18)\n\
+  -c, --chapters=N	pages per chapter, 0 for none (default is 20)\n\
+  -y, --hyphens=N	percent of lines ending with a hyphen (default is 5)\n\
+      --norunning	no running headers and page numbers\n\
+  -h, --help		print this help\n\
+\n\
+The same options and seed give the same document. A page has about\n\
+lines * texts texts.\n\
+\n", MAXFONTS);
+    exit(retval);
+}
+
+struct option longopts[] = {
+    { "chapters",   required_argument, NULL, 'c' },
+    { "fonts",	    required_argument, NULL, 'f' },
+    { "help",	    no_argument, NULL, 'h' },
+    { "hyphens",    required_argument, NULL, 'y' },
+    { "indent",	    required_argument, NULL, 'i' },
+    { "lines",	    required_argument, NULL, 'l' },
+    { "norunning",  no_argument, &options.running, 0 },
+    { "pages",	    required_argument, NULL, 'p' },
+    { "seed",	    required_argument, NULL, 's' },
+    { "texts",	    required_argument, NULL, 't' },
+    {0}
+};
+
+ /*
+  * main - read the options and print the book
+  */
+int main(int argc, char **argv) {
+    int ch, i;
+    while ((ch = getopt_long(argc, argv, "hc:f:i:l:p:s:t:y:", longopts, NULL)) != EOF) {
+	switch (ch) {
+	    case 0:
+		break;
+	    case 'c':
+		options.chapters = strtol(optarg, NULL, 10);
+		break;
+	    case 'f':
+		options.fonts = strtol(optarg, NULL, 10);
+		break;
+	    case 'i':
+		options.indent = strtol(optarg, NULL, 10);
+		break;
+	    case 'l':
+		options.lines = strtol(optarg, NULL, 10);
+		break;
+	    case 'p':
+		options.pages = strtol(optarg, NULL, 10);
+		break;
+	    case 's':
+		options.seed = strtoull(optarg, NULL, 10);
+		break;
+	    case 't':
+		options.texts = strtol(optarg, NULL, 10);
+		break;
+	    case 'y':
+		options.hyphens = strtol(optarg, NULL, 10);
+		break;
+	    case 'h':
+		usage(0);
+		break;
+	    default:
+		usage(1);
+		break;
+	}
+    }
+    if (optind < argc || options.pages < 1 || options.lines < 1 ||
+	options.texts < 1 || options.texts > MAXTEXTS ||
+	options.fonts < 1 || options.fonts > MAXFONTS || options.chapters < 0 ||
+	options.indent < 0 || options.indent > (PAGEWIDTH - 2 * MARGIN) / 2 ||
+	options.hyphens < 0 || options.hyphens > 100)
+	usage(1);
+    book.random = options.seed;
+    setvbuf(stdout, NULL, _IOFBF, 65536);
+    printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    printf("<!DOCTYPE pdf2xml SYSTEM \"pdf2xml.dtd\">\n\n<pdf2xml>\n");
+    for (i = 1; i <= options.pages; i++)
+	printpage(i);
+    printf("</pdf2xml>\n");
+    if (fflush(stdout)) {
+	fprintf(stderr, "Unable to write the document.\n");
+	return 1;
+    }
+    fprintf(stderr, "%d pages, %ld texts\n", options.pages, book.texts);
+    return 0;
+}
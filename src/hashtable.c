@@ -26,75 +26,222 @@
 #include <stdio.h>
 #include <string.h>
 
+ /*
+  * the table is open addressed. slots are in groups of GROUPSIZE, and each
+  * slot has a control byte: EMPTY, DELETED, or the low 7 bits of the hash of
+  * its key. a lookup compares the control bytes of a whole group at once and
+  * only compares keys where the 7 bits match. groups are probed from the one
+  * picked by the rest of the hash, in triangular steps, which visits every
+  * group of a power of two table. a removed slot becomes DELETED, so lookups
+  * go on past it, or EMPTY if its group has another EMPTY slot, since then no
+  * lookup goes past the group.
+  */
+
+#define GROUPSIZE 8
+#define EMPTY 0x80
+#define DELETED 0xfe
+#define ISFULL(ctrl) ((ctrl) < 0x80)
+
+#define LSBS 0x0101010101010101ULL
+#define MSBS 0x8080808080808080ULL
+
 struct hashelement {
     const char *he_key;
     void *he_value;
-    int he_hash;
 };
 
 struct hashtable {
     int ht_count;
-    int ht_allocated;
+    int ht_allocated;		/* slots, a power of two */
+    int ht_growthleft;		/* EMPTY slots that may be filled before a rehash */
     int ht_freevalues;
     int ht_dont_malloc_keys;
     int ht_keys_are_pointers;
     int ht_contains_strings;
     void *ht_context;
     struct hashelement *ht_table;
+    unsigned char *ht_ctrl;	/* a control byte per slot, after ht_table */
     struct hashtable_procs *ht_procs;
 };
 
-static int calcSize(int oldSize) {
-    int start = 8;
-    int size = start - 1;
-    int minSize = 2 * oldSize;
-    while (size < minSize) {
-	start *= 2;
-    	size = start - 1;
-    }
-    return size;
+ /*
+  * maxload
+  *  the keys a table of size slots holds, 7/8 of it
+  */
+static int maxload(int size) {
+    return size - size / 8;
+}
+
+ /*
+  * mix
+  *  spreads every bit of h over all of the result, the murmur3 finalizer
+  */
+static unsigned long long mix(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
 }
 
-static int hash(struct hashtable *table, const char *key, int *sum) {
-    int ch, value = 0;
-    const char *s = key;
-    int length, shift = 0;
+ /*
+  * hash
+  *  the hash of key, the address of a pointer key, FNV-1a of a string
+  */
+static unsigned long long hash(struct hashtable *table, const char *key) {
+    const unsigned char *s = (const unsigned char *)key;
+    unsigned long long h = 0xcbf29ce484222325ULL;
     if (table->ht_keys_are_pointers)
-	return (int)key % table->ht_allocated;
-    length = strlen(key) % 128;
-    while ((ch = *s)) {
-	value += (ch << ((ch & 0xf) + (shift % 4))) - ch;
-	s++;
-	shift++;
+	return mix((unsigned long long)(size_t)key);
+    for (; *s; s++)
+	h = (h ^ *s) * 0x100000001b3ULL;
+    return mix(h);
+}
+
+ /*
+  * loadgroup
+  *  the control bytes of a group, the first in the low byte
+  */
+static unsigned long long loadgroup(const unsigned char *ctrl) {
+    return (unsigned long long)ctrl[0] | ((unsigned long long)ctrl[1] << 8) |
+	((unsigned long long)ctrl[2] << 16) | ((unsigned long long)ctrl[3] << 24) |
+	((unsigned long long)ctrl[4] << 32) | ((unsigned long long)ctrl[5] << 40) |
+	((unsigned long long)ctrl[6] << 48) | ((unsigned long long)ctrl[7] << 56);
+}
+
+ /*
+  * the matches in a group have the top bit of their byte set. matchhash may
+  * match a full slot that does not have hash, the keys are compared anyway
+  */
+static unsigned long long matchhash(unsigned long long group, int h2) {
+    unsigned long long x = group ^ (LSBS * h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+static unsigned long long matchempty(unsigned long long group) {
+    return group & ~(group << 6) & MSBS;
+}
+
+static unsigned long long matchfree(unsigned long long group) {
+    return group & ~(group << 7) & MSBS;
+}
+
+ /*
+  * firstmatch
+  *  the slot in its group of the first match
+  */
+static int firstmatch(unsigned long long match) {
+#ifdef __GNUC__
+    return __builtin_ctzll(match) >> 3;
+#else
+    int i = 0;
+    for (; !(match & 0x80); match >>= 8)
+	i++;
+    return i;
+#endif
+}
+
+ /*
+  * lookup
+  *  returns the slot of key, whose hash is h, or -1
+  */
+static int lookup(struct hashtable *table, const char *key, unsigned long long h) {
+    int mask = table->ht_allocated / GROUPSIZE - 1;
+    int group = (int)(h >> 7) & mask;
+    int step = 0, h2 = (int)(h & 0x7f);
+    for (;;) {
+	int start = group * GROUPSIZE;
+	unsigned long long bits = loadgroup(table->ht_ctrl + start);
+	unsigned long long match = matchhash(bits, h2);
+	for (; match; match &= match - 1) {
+	    int i = start + firstmatch(match);
+	    const char *cur = table->ht_table[i].he_key;
+	    if (cur == key || (!table->ht_keys_are_pointers && !strcmp(cur, key)))
+		return i;
+	}
+	if (matchempty(bits) || step == mask)
+	    return -1;
+	group = (group + ++step) & mask;
     }
-    value = ((value * value) >> 8) | (length << 24) ;
-    value = value & 0x7fffffff;
-    if (sum)
-	*sum = value;
-    return value % table->ht_allocated;
 }
 
-struct hashelement *
-alloctable(struct hashtable *table, int size) {
-    table->ht_table = (struct hashelement *)malloc(size * sizeof(struct hashelement));
+ /*
+  * findfree
+  *  returns the first EMPTY or DELETED slot on the probe of hash h. there is
+  *  always one, the table is never more than 7/8 full
+  */
+static int findfree(struct hashtable *table, unsigned long long h) {
+    int mask = table->ht_allocated / GROUPSIZE - 1;
+    int group = (int)(h >> 7) & mask;
+    int step = 0;
+    for (;;) {
+	int start = group * GROUPSIZE;
+	unsigned long long match = matchfree(loadgroup(table->ht_ctrl + start));
+	if (match)
+	    return start + firstmatch(match);
+	group = (group + ++step) & mask;
+    }
+}
+
+ /*
+  * alloctable
+  *  allocate size slots and their control bytes, all EMPTY
+  */
+static struct hashelement *alloctable(struct hashtable *table, int size) {
+    table->ht_table = malloc(size * (sizeof(struct hashelement) + 1));
     if (table->ht_table) {
-	memset(table->ht_table, 0, (size * sizeof(struct hashelement)));
+	table->ht_ctrl = (unsigned char *)(table->ht_table + size);
+	memset(table->ht_ctrl, EMPTY, size);
 	table->ht_allocated = size;
+	table->ht_growthleft = maxload(size);
     }
     return table->ht_table;
 }
 
+ /*
+  * rehash
+  *  move the keys to a table with room for count keys, no smaller than it
+  *  was, which also drops the DELETED slots. returns -1 if out of memory
+  */
+static int rehash(struct hashtable *table, int count) {
+    struct hashelement *old = table->ht_table;
+    unsigned char *oldctrl = table->ht_ctrl;
+    int i, oldsize = table->ht_allocated;
+    int size = oldsize;
+    while (maxload(size) < count)
+	size *= 2;
+    if (!alloctable(table, size)) {
+	table->ht_table = old;
+	table->ht_ctrl = oldctrl;
+	return -1;
+    }
+    for (i = 0; i < oldsize; i++) {
+	if (ISFULL(oldctrl[i])) {
+	    unsigned long long h = hash(table, old[i].he_key);
+	    int slot = findfree(table, h);
+	    table->ht_ctrl[slot] = (unsigned char)(h & 0x7f);
+	    table->ht_table[slot] = old[i];
+	}
+    }
+    table->ht_growthleft -= table->ht_count;
+    free(old);
+    return 0;
+}
+
 struct hashtable *hashtable_special_create(int size, struct hashtable_procs *procs, void *context) {
     struct hashtable *table;
+    int slots = GROUPSIZE;
     if (!size)
 	size = 5;
-    size = calcSize(size);
+    while (maxload(slots) < size)
+	slots *= 2;
     table = (struct hashtable *)malloc(sizeof(struct hashtable));
     if (table) {
 	memset(table, 0, sizeof(struct hashtable));
 	table->ht_procs = procs;
 	table->ht_context = context;
-	if (!alloctable(table, size)) {
+	if (!alloctable(table, slots)) {
 	    free(table);
 	    table = NULL;
 	}
@@ -114,33 +261,6 @@ struct hashtable *hashtable_string_create(int size) {
     return table;
 }
 
-static int
-mystrcmp(const char *s1, const char *s2) {
-    return strcmp(s1, s2);
-}
-
-static struct hashelement *
-getentry(struct hashtable *table, const char *key, int *hashp) {
-    int sum = 0;
-    int start = hash(table, key, &sum);
-    int index = start;
-    struct hashelement *cur;
-    if (hashp)
-	*hashp = sum;
-    do {
-	cur = table->ht_table + index;
-	if (!cur->he_key)
-	    return cur;
-	else if (cur->he_key == key)
-	    return cur;
-	else if (!table->ht_keys_are_pointers && 
-	    sum == cur->he_hash && !mystrcmp(cur->he_key, key))
-	    return cur;
-	index = (index + 1) % table->ht_allocated;
-    } while (index != start);
-    return NULL;
-}
-
 static void *cleanup(struct hashtable *table, void *old) {
     if (table->ht_procs && table->ht_procs->mp_free) {
 	table->ht_procs->mp_free(table, old, table->ht_context);
@@ -152,114 +272,47 @@ static void *cleanup(struct hashtable *table, void *old) {
     return old;
 }
 
-static void *put(struct hashtable *table, const char *key, void *value, int copykey, int *grew) {
-    int sum = 0;
-    struct hashelement *entry = getentry(table, key, &sum);
-    void *old = entry->he_value;
-    
-    if (grew)
-        *grew = (old == NULL);
-    entry->he_value = value;
-    entry->he_hash = sum;
-    if (!entry->he_key) {
-	if (copykey && !table->ht_dont_malloc_keys) {
-	    entry->he_key = strdup(key);
-	    if (!entry->he_key)
-		return HASHTABLE_ERROR;
-	} else
-	    entry->he_key = key;
-	entry->he_hash = sum;
-    } else {
-	if (table->ht_dont_malloc_keys)
-	    entry->he_key = key;
-    }
-    if (old)
-	old = cleanup(table, old);
-    return old;
-}
-
-static struct hashelement *rehash(struct hashtable *table) {
-    struct hashelement *old = table->ht_table;
-    int oldSize = table->ht_allocated;
-    int newSize = calcSize(oldSize);
-    struct hashelement *cur, *last = old + oldSize;
-    if (alloctable(table, newSize)) {
-	for (cur = old; cur < last; cur++) {
-	    if (cur->he_key) {
-		if (put(table, cur->he_key, cur->he_value, 0, NULL) == HASHTABLE_ERROR)
-		    return NULL;
-	    }
-	}
-    }
-    free(old);
-    return table->ht_table;
-}
-
-static int getcount(struct hashtable *table, struct hashelement *entry) {
-    int i, index = entry - table->ht_table;
-    int count = 0;
-    for (i = 0; i < table->ht_allocated; i++) {
-	struct hashelement *cur = table->ht_table + ((index + i) % table->ht_allocated);
-	if (!cur->he_key)
-	    break;
-	count++;
-    }
-    return count;
-}
-static void getcopy(struct hashtable *table, struct hashelement *copy, struct hashelement *entry, int count) {
-    int i, index = entry - table->ht_table;
-    for (i = 0; i < count; i++) {
-	struct hashelement *cur = table->ht_table + ((index + i) % table->ht_allocated);
-	copy->he_key = cur->he_key;
-	copy->he_value = cur->he_value;
-	cur->he_key = NULL;
-	cur->he_value = NULL;
-	cur->he_hash = 0;
-	copy++;
-    }
+int hashtable_reserve(struct hashtable *table, int count) {
+    if (!table->ht_table)
+	return -1;
+    if (count <= table->ht_count + table->ht_growthleft)
+	return 0;
+    return rehash(table, count);
 }
 
 void *hashtable_remove(struct hashtable *table, const char *key) {
     struct hashelement *entry;
-    void *result = NULL;
+    void *result;
+    char *oldkey;
+    int i;
     if (!table->ht_table)
 	return HASHTABLE_ERROR;
-    entry = getentry(table, key, NULL);
-    if (entry && entry->he_key) {
-	int i, count = getcount(table, entry);
-	char *oldkey;
-	result = entry->he_value;
-	oldkey = (char *)entry->he_key;
-	if (count > 1) {
-	    struct hashelement *copy = (struct hashelement *)malloc(count * sizeof(struct hashelement));
-	    if (!copy)
-		return HASHTABLE_ERROR;
-	    getcopy(table, copy, entry, count);
-	    for (i = 1; i < count; i++) {
-		struct hashelement *cur = copy + i;
-		if (put(table, cur->he_key, cur->he_value, 0, NULL) == HASHTABLE_ERROR)
-		    return HASHTABLE_ERROR;
-	    }
-	    free(copy);
-	} else {
-	    entry->he_key = NULL;
-	    entry->he_value = NULL;
-	    entry->he_hash = 0;
-	}
-	result = cleanup(table, result);
-	if (!table->ht_dont_malloc_keys)
-	    free(oldkey);
-	table->ht_count--;
-    }
+    i = lookup(table, key, hash(table, key));
+    if (i < 0)
+	return NULL;
+    entry = table->ht_table + i;
+    result = entry->he_value;
+    oldkey = (char *)entry->he_key;
+    if (matchempty(loadgroup(table->ht_ctrl + (i & ~(GROUPSIZE - 1))))) {
+	table->ht_ctrl[i] = EMPTY;
+	table->ht_growthleft++;
+    } else
+	table->ht_ctrl[i] = DELETED;
+    entry->he_key = NULL;
+    entry->he_value = NULL;
+    result = cleanup(table, result);
+    if (!table->ht_dont_malloc_keys)
+	free(oldkey);
+    table->ht_count--;
     return result;
 }
 
 void *hashtable_get(struct hashtable *table, const char *key) {
-    struct hashelement *entry;
+    int i;
     if (!table->ht_table)
 	return HASHTABLE_ERROR;
-    entry = getentry(table, key, NULL);
-    return entry ? entry->he_value : NULL;
+    i = lookup(table, key, hash(table, key));
+    return (i >= 0) ? table->ht_table[i].he_value : NULL;
 }
 
 int hashtable_length(struct hashtable *table) {
@@ -268,35 +321,57 @@ int hashtable_length(struct hashtable *table) {
 
 
 void *hashtable_put(struct hashtable *table, const char *key, void *value) {
+    struct hashelement *entry;
+    unsigned long long h;
     void *old;
-    int maxusage = (3 * table->ht_allocated) / 4;
-    int grew;
+    int i;
     
     if (!table->ht_table)
 	return HASHTABLE_ERROR;
-    if ((table->ht_count + 1) >= maxusage)
-	if (!rehash(table))
-	    return HASHTABLE_ERROR;
     if (table->ht_contains_strings) {
 	value = strdup(value);
 	if (!value)
 	    return HASHTABLE_ERROR;
     }
-    old = put(table, key, value, 1, &grew);
-    if (grew)
-	table->ht_count++;
-    return old;
+    h = hash(table, key);
+    i = lookup(table, key, h);
+    if (i >= 0) {
+	entry = table->ht_table + i;
+	old = entry->he_value;
+	entry->he_value = value;
+	if (table->ht_dont_malloc_keys)
+	    entry->he_key = key;
+	return old ? cleanup(table, old) : NULL;
+    }
+    i = findfree(table, h);
+    if (table->ht_ctrl[i] == EMPTY && !table->ht_growthleft) {
+	/* grow by half again, or only drop the DELETED slots if there are many */
+	if (rehash(table, table->ht_count + 1 + table->ht_count / 2) == -1)
+	    return HASHTABLE_ERROR;
+	i = findfree(table, h);
+    }
+    if (!table->ht_dont_malloc_keys) {
+	key = strdup(key);
+	if (!key)
+	    return HASHTABLE_ERROR;
+    }
+    if (table->ht_ctrl[i] == EMPTY)
+	table->ht_growthleft--;
+    table->ht_ctrl[i] = (unsigned char)(h & 0x7f);
+    entry = table->ht_table + i;
+    entry->he_key = key;
+    entry->he_value = value;
+    table->ht_count++;
+    return NULL;
 }
 
 void hashtable_enumerate(struct hashtable *table, int (*proc)(const char *key, void *value, void *context), void *context) {
-    struct hashelement *start, *last;
+    int i;
     if (!table->ht_table)
 	return;
-    start = table->ht_table;
-    last = start + table->ht_allocated;
-    for (; start < last; start++) {
-	if (start->he_key) {
-	    if ((*proc)(start->he_key, start->he_value, context))
+    for (i = 0; i < table->ht_allocated; i++) {
+	if (ISFULL(table->ht_ctrl[i])) {
+	    if ((*proc)(table->ht_table[i].he_key, table->ht_table[i].he_value, context))
 		return;
 	}
     }
@@ -317,17 +392,7 @@ void hashtable_set_keys_are_pointers(struct hashtable *table) {
 
 void hashtable_free(struct hashtable *table) {
     if (table->ht_table) {
-	struct hashelement *start = table->ht_table;
-	struct hashelement *last = start + table->ht_allocated;
-	for (; start < last; start++) {
-	    if (start->he_key) {
-		start->he_value = cleanup(table, start->he_value);
-		if (!table->ht_dont_malloc_keys)
-		    free((char *)start->he_key);
-		start->he_key = NULL;
-		start->he_hash = 0;
-	    }
-	}
+	hashtable_clean(table);
 	free(table->ht_table);
     }
     free(table);
@@ -335,33 +400,32 @@ void hashtable_free(struct hashtable *table) {
 
 struct array *hashtable_keys(struct hashtable *table, int copystrings) {
     struct array *result = copystrings ? array_string_init(0) : array_pointer_init(0);
+    int i;
     if (table->ht_table && result) {
-	struct hashelement *start = table->ht_table;
-	struct hashelement *last = start + table->ht_allocated;
-	for (; start < last; start++) {
-	    if (start->he_key) {
-		array_append_element(result, (char *)start->he_key);
-	    }
+	for (i = 0; i < table->ht_allocated; i++) {
+	    if (ISFULL(table->ht_ctrl[i]))
+		array_append_element(result, (char *)table->ht_table[i].he_key);
 	}
     }
     return result;
 }
 
 void hashtable_clean(struct hashtable *table) {
-    struct hashelement *start, *last;
+    struct hashelement *entry;
+    int i;
     if (!table->ht_table)
 	return;
-    start = table->ht_table;
-    last = start + table->ht_allocated;
-    for (; start < last; start++) {
-	if (start->he_key) {
-	    start->he_value = cleanup(table, start->he_value);
+    for (i = 0; i < table->ht_allocated; i++) {
+	if (ISFULL(table->ht_ctrl[i])) {
+	    entry = table->ht_table + i;
+	    entry->he_value = cleanup(table, entry->he_value);
 	    if (!table->ht_dont_malloc_keys)
-		free((char *)start->he_key);
-	    start->he_key = NULL;
-	    start->he_hash = 0;
-	    start->he_value = NULL;
+		free((char *)entry->he_key);
+	    entry->he_key = NULL;
+	    entry->he_value = NULL;
 	}
     }
+    memset(table->ht_ctrl, EMPTY, table->ht_allocated);
     table->ht_count = 0;
+    table->ht_growthleft = maxload(table->ht_allocated);
 }
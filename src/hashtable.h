@@ -31,6 +31,8 @@ void *hashtable_put(struct hashtable *table, const char *key, void *value);
 void *hashtable_get(struct hashtable *table, const char *key);
 void *hashtable_remove(struct hashtable *table, const char *key);
 int hashtable_length(struct hashtable *table);
+int hashtable_reserve(struct hashtable *table, int count);
+	/* makes room for count keys without growing, returns -1 if out of memory */
 void hashtable_free(struct hashtable *table);
 
 void hashtable_enumerate(struct hashtable *table, int (*proc)(const char *key, void *value, void *context), void *context);
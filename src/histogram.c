@@ -0,0 +1,207 @@
+/*
+ * histogram.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+#include "hashtable.h"
+#include "array.h"
+
+#define HISTOGRAM_MIN	(-256)	/* smallest value kept in the dense counts */
+#define HISTOGRAM_SIZE	4096	/* number of dense counts, values past it go to the overflow table */
+
+struct histogram {
+    int *counts;			/* counts of HISTOGRAM_MIN .. HISTOGRAM_MIN + HISTOGRAM_SIZE - 1 */
+    int lo, hi;				/* range of dense indexes in use, lo > hi if none */
+    int length;				/* number of distinct values */
+    struct hashtable *overflow;		/* key=value, val=count of values outside the dense range */
+};
+
+ /*
+  * histogram_create
+  *  create an empty histogram of integers
+  */
+struct histogram *histogram_create() {
+    struct histogram *hist = malloc(sizeof(struct histogram));
+    hist->counts = NULL;
+    hist->lo = HISTOGRAM_SIZE;
+    hist->hi = -1;
+    hist->length = 0;
+    hist->overflow = NULL;
+    return hist;
+}
+
+ /*
+  * histogram_free
+  *  frees a histogram
+  */
+void histogram_free(struct histogram *hist) {
+    if (!hist)
+	return;
+    free(hist->counts);
+    if (hist->overflow)
+	hashtable_free(hist->overflow);
+    free(hist);
+}
+
+ /*
+  * addoverflow
+  *  count a value outside of the dense range
+  */
+static void addoverflow(struct histogram *hist, int val) {
+    long count;
+    if (!hist->overflow) {
+	hist->overflow = hashtable_create(0);
+	hashtable_set_keys_are_pointers(hist->overflow);
+    }
+    count = (long)hashtable_get(hist->overflow, (void *)(long)val);
+    if (!count)
+	hist->length++;
+    hashtable_put(hist->overflow, (void *)(long)val, (void *)(count + 1));
+}
+
+ /*
+  * histogram_add
+  *  count one more occurrence of val
+  */
+void histogram_add(struct histogram *hist, int val) {
+    unsigned index = (unsigned)val - (unsigned)HISTOGRAM_MIN;
+    if (index >= HISTOGRAM_SIZE) {
+	addoverflow(hist, val);
+	return;
+    }
+    if (!hist->counts)
+	hist->counts = calloc(HISTOGRAM_SIZE, sizeof(int));
+    if (!hist->counts[index]++) {
+	hist->length++;
+	if ((int)index < hist->lo)
+	    hist->lo = index;
+	if ((int)index > hist->hi)
+	    hist->hi = index;
+    }
+}
+
+ /*
+  * histogram_count
+  *  returns the number of times val was added
+  */
+int histogram_count(struct histogram *hist, int val) {
+    unsigned index = (unsigned)val - (unsigned)HISTOGRAM_MIN;
+    if (index < HISTOGRAM_SIZE)
+	return hist->counts ? hist->counts[index] : 0;
+    if (!hist->overflow)
+	return 0;
+    return (int)(long)hashtable_get(hist->overflow, (void *)(long)val);
+}
+
+ /*
+  * histogram_length
+  *  returns the number of distinct values added
+  */
+int histogram_length(struct histogram *hist) {
+    return hist->length;
+}
+
+ /*
+  * before
+  *  returns 1 if entry a goes ahead of entry b: higher count, then lower value
+  */
+static int before(struct histogram_entry *a, struct histogram_entry *b) {
+    if (a->count != b->count)
+	return a->count > b->count;
+    return a->val < b->val;
+}
+
+ /*
+  * entrycompare
+  *  qsort call back, most frequent first
+  */
+static int entrycompare(const void *p1, const void *p2) {
+    struct histogram_entry *e1 = (struct histogram_entry *)p1;
+    struct histogram_entry *e2 = (struct histogram_entry *)p2;
+    if (before(e1, e2))
+	return -1;
+    if (before(e2, e1))
+	return 1;
+    return 0;
+}
+
+ /*
+  * keep
+  *  add an entry to the top list when it is among the first max, the list is
+  *  kept sorted. returns the new length of the list
+  */
+static int keep(struct histogram_entry *entries, int length, int max, int val, int count) {
+    struct histogram_entry entry;
+    int i;
+    entry.val = val;
+    entry.count = count;
+    if (length == max) {
+	if (!before(&entry, &entries[max - 1]))
+	    return length;
+	length--;
+    }
+    for (i = length; i > 0 && before(&entry, &entries[i - 1]); i--)
+	entries[i] = entries[i - 1];
+    entries[i] = entry;
+    return length + 1;
+}
+
+ /*
+  * histogram_top
+  *  fill entries with up to max values, most frequent first, ties by ascending
+  *  value. returns the number of entries filled
+  */
+int histogram_top(struct histogram *hist, struct histogram_entry *entries, int max) {
+    int i, length = 0, all = max >= hist->length;
+    
+    if (max <= 0)
+	return 0;
+    for (i = hist->lo; i <= hist->hi; i++) {
+	int count = hist->counts[i];
+	if (!count)
+	    continue;
+	if (all) {
+	    entries[length].val = i + HISTOGRAM_MIN;
+	    entries[length++].count = count;
+	} else
+	    length = keep(entries, length, max, i + HISTOGRAM_MIN, count);
+    }
+    if (hist->overflow) {
+	struct array *keys = hashtable_keys(hist->overflow, 0);
+	int n = array_length(keys);
+	for (i = 0; i < n; i++) {
+	    void *key = array_elementat(keys, i);
+	    int val = (int)(long)key;
+	    int count = (int)(long)hashtable_get(hist->overflow, key);
+	    if (all) {
+		entries[length].val = val;
+		entries[length++].count = count;
+	    } else
+		length = keep(entries, length, max, val, count);
+	}
+	array_free(keys);
+    }
+    if (all)
+	qsort(entries, length, sizeof(struct histogram_entry), entrycompare);
+    return length;
+}
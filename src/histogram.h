@@ -0,0 +1,72 @@
+/*
+ * histogram.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_HISTOGRAM_H
+#define INCLUDED_HISTOGRAM_H
+struct histogram;
+
+ /*
+  * histogram_entry
+  *  a value and the number of times it was added
+  */
+struct histogram_entry {
+    int val;
+    int count;
+};
+
+ /*
+  * histogram_create
+  *  create an empty histogram of integers
+  */
+struct histogram *histogram_create();
+
+ /*
+  * histogram_free
+  *  frees a histogram
+  */
+void histogram_free(struct histogram *hist);
+
+ /*
+  * histogram_add
+  *  count one more occurrence of val
+  */
+void histogram_add(struct histogram *hist, int val);
+
+ /*
+  * histogram_count
+  *  returns the number of times val was added
+  */
+int histogram_count(struct histogram *hist, int val);
+
+ /*
+  * histogram_length
+  *  returns the number of distinct values added
+  */
+int histogram_length(struct histogram *hist);
+
+ /*
+  * histogram_top
+  *  fill entries with up to max values, most frequent first, ties by ascending
+  *  value. returns the number of entries filled
+  */
+int histogram_top(struct histogram *hist, struct histogram_entry *entries, int max);
+
+#endif /* INCLUDED_HISTOGRAM_H */
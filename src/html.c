@@ -21,6 +21,7 @@
 
 #include <config.h>
 #include "attr.h"
+#include "doc.h"
 #include "font.h"
 #include "html.h"
 #include "parse.h"
@@ -28,6 +29,7 @@
 #include "array.h"
 #include "hashtable.h"
 #include "linetable.h"
+#include "sink.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -50,13 +52,6 @@ struct FontDesc {
     int id;			/* id is the span number, ie id=5 generates span.s5 {...} */
 };
 
-static struct hashtable *styles = NULL;
-static struct hashtable *fonts = NULL;
-static int counters[10] = {0};
-static int html_showstyle = 0;
-static int html_absfontsize = 0;
-static struct FontDesc *html_defaultfont = NULL;
-
 static int styletoid[] = {
     1,
     1,
@@ -85,16 +80,14 @@ static char *construct[] = {
     "blockquote",
 };
 
-static int curfontid = 0;
-static int html_rag = 0;
-static struct FontDesc *html_getfont(struct Atom *name);
+static struct FontDesc *html_getfont(struct Doc *doc, int name);
 
  /*
   * html_setshowstyle
   *  print debugging info when styles are created
   */
-void html_setshowstyle() {
-    html_showstyle = 1;
+void html_setshowstyle(struct Doc *doc) {
+    doc->html_showstyle = 1;
 }
 
 
@@ -102,16 +95,16 @@ void html_setshowstyle() {
   * html_setabsolute
   *  use absolute font sizes in output, rather than relative (percentage)
   */
-void html_setabsolute() {
-    html_absfontsize = 1;
+void html_setabsolute(struct Doc *doc) {
+    doc->html_absfontsize = 1;
 }
 
  /*
   * html_setrag
   *  tells that the text is rag right
   */
-void html_setrag() {
-    html_rag = 1;
+void html_setrag(struct Doc *doc) {
+    doc->html_rag = 1;
 }
 
 static void style_free(struct hashtable *table, void *value, void *context) {
@@ -134,40 +127,52 @@ static struct hashtable_procs fontprocs = {
 
  /*
   * styleinit
-  *  init some static hash tables - the styles and fonts of the document
+  *  init the hash tables of the styles and fonts of the document
+  */
+static void styleinit(struct Doc *doc) {
+    doc->html_styles = hashtable_special_create(0, &styleprocs, NULL);
+    doc->html_fonts = hashtable_special_create(0, &fontprocs, NULL);
+}
+
+ /*
+  * html_free
+  *  frees the styles and fonts of the document
   */
-static void styleinit() {
-    styles = hashtable_special_create(0, &styleprocs, NULL);
-    fonts = hashtable_special_create(0, &fontprocs, NULL);
+void html_free(struct Doc *doc) {
+    if (doc->html_styles)
+	hashtable_free(doc->html_styles);
+    if (doc->html_fonts)
+	hashtable_free(doc->html_fonts);
+    doc->html_styles = NULL;
+    doc->html_fonts = NULL;
+    doc->html_defaultfont = NULL;
 }
 
  /*
   * style_init
   *  create a style
   */
-static struct Style *style_init(struct FontDesc *font, struct Atom *family, int fontsize, enum para_style styleval, int marginleft, int marginright, int otherval) {
+static struct Style *style_init(struct Doc *doc, struct FontDesc *font, struct Atom *family, int fontsize, enum para_style styleval, int marginleft, int marginright, int otherval) {
     struct Style *style = calloc(1, sizeof(struct Style));
     int idmap = styletoid[styleval];
     
-    counters[idmap]++;
+    doc->html_counters[idmap]++;
     style->family = family;
     style->fontsize = fontsize;
     style->style = styleval;
     style->marginleft = marginleft;
     style->marginright = marginright;
     style->otherval = otherval;
-    style->id = counters[idmap];
+    style->id = doc->html_counters[idmap];
     style->fontdesc = font;
     return style;
 }
 
-static int html_musthave = 0;
-
  /*
   * html_getstyle
   *  gets a unique style
   */
-static struct Style *html_getstyle(struct FontDesc *font, enum para_style styleval, struct Rect r, int otherval, int left, int width) {
+static struct Style *html_getstyle(struct Doc *doc, struct FontDesc *font, enum para_style styleval, struct Rect r, int otherval, int left, int width) {
     char key[200];
     struct Style *style;
     char *family = (char *)font->family;
@@ -178,21 +183,23 @@ static struct Style *html_getstyle(struct FontDesc *font, enum para_style stylev
     if (otherval >= -1 && otherval <= 1) 
 	otherval = 0;
 	
-    if (html_rag)
+    if (doc->html_rag)
 	right = 0;
     if (right < 6)
 	right = 0;
     if (lmargin < 6)
 	lmargin = 0;
     sprintf(key, "%s:%d:%d:%d:%d:%d", family, fontsize, (int) styleval, lmargin, right, otherval);
-    style = hashtable_get(styles, key);
+    if (!doc->html_styles)
+	styleinit(doc);
+    style = hashtable_get(doc->html_styles, key);
     if (!style) {
-	if (html_showstyle) 
-	    fprintf(stderr, "Style font: %s-%d, style:%s, lm:%d, rm:%d, in:%d\n", 
+	if (doc->html_showstyle) 
+	    sink_printf(doc->diag, "Style font: %s-%d, style:%s, lm:%d, rm:%d, in:%d\n", 
 		family, fontsize, html_parstylestr(styleval), r.left - left,
 		right, otherval);
-	style = style_init(font, font->family, fontsize, styleval, lmargin, right, otherval);
-	hashtable_put(styles, key, style);
+	style = style_init(doc, font, font->family, fontsize, styleval, lmargin, right, otherval);
+	hashtable_put(doc->html_styles, key, style);
     }
     return style;
 }
@@ -201,12 +208,12 @@ static struct Style *html_getstyle(struct FontDesc *font, enum para_style stylev
   * fontdesc_init
   *  inits a font object used in uniquing all fonts
   */
-static struct FontDesc *fontdesc_init(struct Atom *name, int fontsize) {
+static struct FontDesc *fontdesc_init(struct Doc *doc, struct Atom *name, int fontsize) {
     struct FontDesc *font = calloc(1, sizeof(struct FontDesc));
-    curfontid++;
+    doc->html_curfontid++;
     font->family = name;
     font->fontsize = fontsize;
-    font->id = curfontid;
+    font->id = doc->html_curfontid;
     return font;
 }
 
@@ -215,29 +222,28 @@ static struct FontDesc *fontdesc_init(struct Atom *name, int fontsize) {
   * html_getfont
   *  returns a font that matches name and fontsize. fonts are made unique
   */
-static struct FontDesc *html_getfont(struct Atom *name) {
+static struct FontDesc *html_getfont(struct Doc *doc, int name) {
     char key[200];
     struct FontDesc *fontdesc;
-    char *family = font_family(name);
-    int fontsize = font_size(name);
+    char *family = font_family(doc, name);
+    int fontsize = font_size(doc, name);
     sprintf(key, "%s:%d", family, fontsize);
-    if (!fonts)
-	styleinit();
-    fontdesc = hashtable_get(fonts, key);
+    if (!doc->html_fonts)
+	styleinit(doc);
+    fontdesc = hashtable_get(doc->html_fonts, key);
     if (!fontdesc) {
-	fontdesc = fontdesc_init((struct Atom *)family, fontsize);
-	hashtable_put(fonts, key, fontdesc);
+	fontdesc = fontdesc_init(doc, (struct Atom *)family, fontsize);
+	hashtable_put(doc->html_fonts, key, fontdesc);
     }
     return fontdesc;
 }
 
  /*
   * html_setdefaultfont
-  *  sets the default font for document -- printstr format Atom, ie Times-12
+  *  sets the default font for document, a font index as returned by font_printindex
   */
-void html_setdefaultfont(struct Atom *defaultfont) {
-    struct Atom *font = font_fromprintstr(defaultfont);
-    html_defaultfont = html_getfont(font);
+void html_setdefaultfont(struct Doc *doc, int defaultfont) {
+    doc->html_defaultfont = html_getfont(doc, defaultfont);
 }
 
 static int html_approx_match(int pos1, int pos2) {
@@ -251,8 +257,6 @@ static int html_approx_match(int pos1, int pos2) {
   *  cleans up rect based on style
   */
 struct Rect html_adjustrect(enum para_style styleval,  struct Rect r, int left, int width) {
-    if (!styles)
-	styleinit();
     if (html_approx_match(left, r.left)) {
 	r.left = left;
     }
@@ -274,16 +278,16 @@ struct Rect html_adjustrect(enum para_style styleval,  struct Rect r, int left,
   *  finds the default font for a paragraph. If the paragraph contains the html_defaultfont, then
   *  that font is chosen. Otherwise, use the first font of the paragraph
   */
-static struct FontDesc *fontforpara(struct array *texts, int startindex, int endindex) {
+static struct FontDesc *fontforpara(struct Doc *doc, struct array *texts, int startindex, int endindex) {
     struct Text *text;
     struct FontDesc *cur, *first = NULL;
     int i;
     for (i = startindex; i <= endindex; i++) {
 	text = array_elementat(texts, i);
-	cur = html_getfont(text_font(text));
+	cur = html_getfont(doc, text_font(text));
 	if (i == startindex)
 	    first = cur;
-	if (cur == html_defaultfont)
+	if (cur == doc->html_defaultfont)
 	    return cur;
     }
     return first;
@@ -294,17 +298,17 @@ static struct FontDesc *fontforpara(struct array *texts, int startindex, int end
   * html_notestyle
   *  records a style, which is uniqued
   */
-void html_notestyle(struct array *texts, int startindex, int endindex, enum para_style styleval,  struct Rect r, int otherval, int left, int width) {
+void html_notestyle(struct Doc *doc, struct array *texts, int startindex, int endindex, enum para_style styleval,  struct Rect r, int otherval, int left, int width) {
     struct Style *style;
     struct Text *text;
-    struct FontDesc *font = fontforpara(texts, startindex, endindex);
+    struct FontDesc *font = fontforpara(doc, texts, startindex, endindex);
     int i;
     
     r = html_adjustrect(styleval, r, left, width);
-    style = html_getstyle(font, styleval, r, otherval, left, width);
+    style = html_getstyle(doc, font, styleval, r, otherval, left, width);
     for (i = startindex; i <= endindex; i++) {
 	text = array_elementat(texts, i);
-	html_getfont(text_font(text));
+	html_getfont(doc, text_font(text));
     }
 }
 
@@ -312,47 +316,57 @@ void html_notestyle(struct array *texts, int startindex, int endindex, enum para
   * html_printtext
   *  prints a single text object
   */
-static void html_printtext(FILE *file, struct Style *style, struct Text *text, int first, int last, int oneliner, int needs_break, struct Text *next) {
-    struct FontDesc *fontdesc = html_getfont(text_font(text));
+static void html_printtext(struct Doc *doc, struct Sink *sink, struct Style *style, struct Text *text, int first, int last, int oneliner, int needs_break, struct Text *next) {
+    struct FontDesc *fontdesc = html_getfont(doc, text_font(text));
     int needspan = (fontdesc == style->fontdesc) ? 0 : 1;
+    if (needspan) {
+	sink_puts(sink, "<span class=\"s");
+	sink_putint(sink, fontdesc->id);
+	sink_puts(sink, "\">");
+    }
+    text_printtext(text, next, first, sink);
     if (needspan) 
-	fprintf(file, "<span class=\"s%d\">", fontdesc->id);
-    text_printtext(text, next, first, file);
-    if (needspan) 
-	fprintf(file, "</span>");
+	sink_puts(sink, "</span>");
     if (style->style == align_center || style->style == align_unknown) {
 	if (!oneliner && !last && needs_break)
-	    fprintf(file, "<br>");
+	    sink_puts(sink, "<br>");
     }
     if (!last)
-	fprintf(file, "\n");
+	sink_putc(sink, '\n');
 }
 
  /*
   * html_printtexts
   *  prints the paragraph text
   */
-void html_printtexts(FILE *file, struct array *texts, struct Line *startline, int endindex, enum para_style styleval,  struct Rect r, int otherval, int left, int width) {
+void html_printtexts(struct Doc *doc, struct Sink *sink, struct array *texts, struct Line *startline, int endindex, enum para_style styleval,  struct Rect r, int otherval, int left, int width) {
     struct Style *style;
     char *element;
     int startindex = startline->index;
     struct Text *text;
-    struct FontDesc *font = fontforpara(texts, startindex, endindex);
+    struct FontDesc *font = fontforpara(doc, texts, startindex, endindex);
     int i;
     
-    html_musthave = 1;
+    doc->html_musthave = 1;
     r = html_adjustrect(styleval, r, left, width);
-    style = html_getstyle(font, styleval, r, otherval, left, width);
+    style = html_getstyle(doc, font, styleval, r, otherval, left, width);
     element = construct[style->style];
-    fprintf(file, "<%s class=\"%c%d\">", element, element[0], style->id);
+    sink_putc(sink, '<');
+    sink_puts(sink, element);
+    sink_puts(sink, " class=\"");
+    sink_putc(sink, element[0]);
+    sink_putint(sink, style->id);
+    sink_puts(sink, "\">");
     for (i = startindex; i <= endindex; i++) {
 	int needs_break = (i == (startline[1].index - 1));
 	text = array_elementat(texts, i);
-	html_printtext(file, style, text, i == startindex, i == endindex, startindex == endindex, needs_break, array_elementat(texts, i+1));
+	html_printtext(doc, sink, style, text, i == startindex, i == endindex, startindex == endindex, needs_break, array_elementat(texts, i+1));
 	if (needs_break)
 	    startline++;
     }
-    fprintf(file, "</%s>\n", element);
+    sink_puts(sink, "</");
+    sink_puts(sink, element);
+    sink_puts(sink, ">\n");
 }
 
  /*
@@ -411,93 +425,136 @@ struct array *html_getlist(struct hashtable *hash, int (*proc)(const void *p1, c
   * html_getfontlist
   *  return a list of all the fonts
   */
-struct array *html_getfontlist() {
-    return html_getlist(fonts, fontcompare);
+struct array *html_getfontlist(struct Doc *doc) {
+    return html_getlist(doc->html_fonts, fontcompare);
 }
 
  /*
   * html_getstylelist
   *  return a list of all the styles
   */
-struct array *html_getstylelist() {
-    return html_getlist(styles, stylecompare);
+struct array *html_getstylelist(struct Doc *doc) {
+    return html_getlist(doc->html_styles, stylecompare);
+}
+
+ /*
+  * printproperty
+  *  prints a css property of a class. the family of an unknown font is
+  *  NULL, and is printed as (null) the way printf did
+  */
+static void printproperty(struct Sink *sink, char *name, char *value) {
+    sink_puts(sink, "    ");
+    sink_puts(sink, name);
+    sink_puts(sink, ": ");
+    sink_puts(sink, value ? value : "(null)");
+    sink_puts(sink, ";\n");
+}
+
+ /*
+  * printpx
+  *  prints a css property of a class in pixels
+  */
+static void printpx(struct Sink *sink, char *name, int value) {
+    sink_puts(sink, "    ");
+    sink_puts(sink, name);
+    sink_puts(sink, ": ");
+    sink_putint(sink, value);
+    sink_puts(sink, "px;\n");
+}
+
+ /*
+  * printfontsize
+  *  prints the font-size of a class, in pixels or relative to the default font
+  */
+static void printfontsize(struct Doc *doc, struct Sink *sink, int fontsize, int relsize) {
+    if (doc->html_absfontsize)
+	printpx(sink, "font-size", fontsize);
+    else {
+	sink_puts(sink, "    font-size: ");
+	sink_putint(sink, relsize);
+	sink_puts(sink, "%;\n");
+    }
 }
 
  /*
   * html_printstyle
   *  prints a paragraph class
   */
-static void html_printstyle(FILE *file, struct Style *style) {
+static void html_printstyle(struct Doc *doc, struct Sink *sink, struct Style *style) {
     char *element = construct[style->style];
-    fprintf(file, "%s.%c%d {\n", element, element[0], style->id);
+    sink_puts(sink, element);
+    sink_putc(sink, '.');
+    sink_putc(sink, element[0]);
+    sink_putint(sink, style->id);
+    sink_puts(sink, " {\n");
     if (style->marginleft)
-	fprintf(file, "    margin-left: %dpx;\n", style->marginleft);
-    if (!html_rag && style->marginright)
-	fprintf(file, "    margin-right: %dpx;\n", style->marginright);
-    fprintf(file, "    text-align: %s;\n", aligns[style->style]);
+	printpx(sink, "margin-left", style->marginleft);
+    if (!doc->html_rag && style->marginright)
+	printpx(sink, "margin-right", style->marginright);
+    printproperty(sink, "text-align", aligns[style->style]);
     if (style->style == align_indent || style->style == align_outdent)
-	fprintf(file, "    text-indent: %dpx;\n", style->otherval);
-    if (style->fontdesc != html_defaultfont) {
-	if (style->family != html_defaultfont->family)
-	    fprintf(file, "    font-family: %s;\n", (char *)style->family);
-	if (style->fontsize != html_defaultfont->fontsize) {
-	    if (html_absfontsize)
-		fprintf(file, "    font-size: %dpx;\n", style->fontsize);
-	    else
-		fprintf(file, "    font-size: %d%s;\n", style->relsize, "%");
-	}
+	printpx(sink, "text-indent", style->otherval);
+    if (style->fontdesc != doc->html_defaultfont) {
+	if (style->family != doc->html_defaultfont->family)
+	    printproperty(sink, "font-family", (char *)style->family);
+	if (style->fontsize != doc->html_defaultfont->fontsize)
+	    printfontsize(doc, sink, style->fontsize, style->relsize);
     }
-    fprintf(file, "}\n\n");
+    sink_puts(sink, "}\n\n");
 }
 
  /*
   * html_printfontdesc
   *  prints a span class
   */
-static void html_printfontdesc(FILE *file, struct FontDesc *fontdesc) {
-    fprintf(file, "span.s%d {\n", fontdesc->id);
-    fprintf(file, "    font-family: %s;\n", (char *)fontdesc->family);
-    if (html_absfontsize)
-	fprintf(file, "    font-size: %dpx;\n", fontdesc->fontsize);
-    else
-	fprintf(file, "    font-size: %d%s;\n", fontdesc->relsize, "%");
-    fprintf(file, "}\n\n");
+static void html_printfontdesc(struct Doc *doc, struct Sink *sink, struct FontDesc *fontdesc) {
+    sink_puts(sink, "span.s");
+    sink_putint(sink, fontdesc->id);
+    sink_puts(sink, " {\n");
+    printproperty(sink, "font-family", (char *)fontdesc->family);
+    printfontsize(doc, sink, fontdesc->fontsize, fontdesc->relsize);
+    sink_puts(sink, "}\n\n");
 }
 
  /*
   * printintro
   *  prints the beginning of the html file
   */
-static void printintro(FILE *file) {
-    fprintf(file, "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">\n");
-    fprintf(file, "<html>\n");
-    fprintf(file, "<head>\n");
-    fprintf(file, "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=%s\">\n", parse_encoding());
+static void printintro(struct Doc *doc, struct Sink *sink) {
+    sink_puts(sink, "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">\n");
+    sink_puts(sink, "<html>\n");
+    sink_puts(sink, "<head>\n");
+    sink_puts(sink, "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=");
+    sink_puts(sink, parse_encoding(doc) ? parse_encoding(doc) : "(null)");
+    sink_puts(sink, "\">\n");
 }
 
  /*
   * printbodystyle
   *  print body css entry if necessary
   */
-static void printbodystyle(FILE *file) {
-    if (html_absfontsize) {
-	fprintf(file, "body {\n");
-	fprintf(file, "    font-family: %s;\n", (char *)html_defaultfont->family);
-	fprintf(file, "    font-size: %dpx;\n", html_defaultfont->fontsize);
-	fprintf(file, "}\n\n");
+static void printbodystyle(struct Doc *doc, struct Sink *sink) {
+    if (doc->html_absfontsize) {
+	sink_puts(sink, "body {\n");
+	printproperty(sink, "font-family", (char *)doc->html_defaultfont->family);
+	printpx(sink, "font-size", doc->html_defaultfont->fontsize);
+	sink_puts(sink, "}\n\n");
     }
 }
 
 static int mods[] = {0, 20, 25, 33, 40, 50, 60, 67, 75, 80, 100};
  /*
   * calcrelsize
-  *  calculate the percentage relative to the default font size
+  *  calculate the percentage relative to the default font size. an undefined
+  *  font has size -1, it gets 0 which calcrelsize raises to the minimum
   */
-static int realcalcrelsize(int fontsize) {
-    if (fontsize == html_defaultfont->fontsize)
+static int realcalcrelsize(struct Doc *doc, int fontsize) {
+    if (fontsize <= 0)
+	return 0;
+    if (fontsize == doc->html_defaultfont->fontsize)
 	return 100;
     else {
-	int relsize = (fontsize * 100) / html_defaultfont->fontsize;
+	int relsize = (fontsize * 100) / doc->html_defaultfont->fontsize;
 	int div = relsize / 100;
 	int mod = relsize % 100;
 	int *cur, d1, d2;
@@ -516,8 +573,8 @@ static int realcalcrelsize(int fontsize) {
     }
 }
 
-static int calcrelsize(int fontsize) {
-    int relsize = realcalcrelsize(fontsize);
+static int calcrelsize(struct Doc *doc, int fontsize) {
+    int relsize = realcalcrelsize(doc, fontsize);
     if (relsize < 75)
 	relsize = 75;
     if (relsize > 300)
@@ -530,31 +587,34 @@ static int calcrelsize(int fontsize) {
   * html_printstyles
   *  enumerate styles for css tag in head section
   */
-void html_printstyles(FILE *file) {
-    struct array *stylelist = html_getstylelist();
-    struct array *fontlist = html_getfontlist();
+void html_printstyles(struct Doc *doc, struct Sink *sink) {
+    struct array *stylelist, *fontlist;
     int i, length;
-    printintro(file);
-    fprintf(file, "<style type=\"text/css\">\n");
-    printbodystyle(file);
+    if (!doc->html_styles)
+	styleinit(doc);
+    stylelist = html_getstylelist(doc);
+    fontlist = html_getfontlist(doc);
+    printintro(doc, sink);
+    sink_puts(sink, "<style type=\"text/css\">\n");
+    printbodystyle(doc, sink);
     length = array_length(fontlist);
     length = array_length(stylelist);
     for (i = 0; i < length; i++) {
 	struct Style *style = array_elementat(stylelist, i);
-	style->relsize = calcrelsize(style->fontsize);
-	html_printstyle(file, style);
+	style->relsize = calcrelsize(doc, style->fontsize);
+	html_printstyle(doc, sink, style);
     }
     length = array_length(fontlist);
     for (i = 0; i < length; i++) {
 	struct FontDesc *fontdesc = array_elementat(fontlist, i);
-	if (fontdesc != html_defaultfont) {
-	    fontdesc->relsize = calcrelsize(fontdesc->fontsize);
-	    html_printfontdesc(file, fontdesc);
+	if (fontdesc != doc->html_defaultfont) {
+	    fontdesc->relsize = calcrelsize(doc, fontdesc->fontsize);
+	    html_printfontdesc(doc, sink, fontdesc);
 	}
     }
-    fprintf(file, "</style>\n");
-    fprintf(file, "</head>\n");
-    fprintf(file, "</body>\n");
+    sink_puts(sink, "</style>\n");
+    sink_puts(sink, "</head>\n");
+    sink_puts(sink, "</body>\n");
     array_free(stylelist);
     array_free(fontlist);
 }
@@ -563,9 +623,9 @@ void html_printstyles(FILE *file) {
   * html_printtail
   *  prints the end of the html file
   */
-void html_printtail(FILE *file) {
-    fprintf(file, "</body>\n");
-    fprintf(file, "</html>\n");
+void html_printtail(struct Sink *sink) {
+    sink_puts(sink, "</body>\n");
+    sink_puts(sink, "</html>\n");
 }
 
  /*
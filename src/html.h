@@ -42,42 +42,44 @@ enum para_style {
 struct array;
 struct Atom;
 struct Line;
+struct Doc;
+struct Sink;
 
  /*
   * html_printtexts
   *  prints the paragraph text
   */
-void html_printtexts(FILE *file, struct array *texts, struct Line *startline, int endindex, enum para_style style,  struct Rect r, int otherval, int left, int width);
+void html_printtexts(struct Doc *doc, struct Sink *sink, struct array *texts, struct Line *startline, int endindex, enum para_style style,  struct Rect r, int otherval, int left, int width);
 
  /*
   * html_notestyle
   *  records a style, which is uniqued
   */
-void html_notestyle(struct array *texts, int startindex, int endindex, enum para_style style,  struct Rect r, int otherval, int left, int width);
+void html_notestyle(struct Doc *doc, struct array *texts, int startindex, int endindex, enum para_style style,  struct Rect r, int otherval, int left, int width);
 
  /*
   * html_printstyles
   *  enumerate styles for css tag in head section
   */
-void html_printstyles(FILE *file);
+void html_printstyles(struct Doc *doc, struct Sink *sink);
 
  /*
   * html_setrag
   *  tells that the text is rag right
   */
-void html_setrag();
+void html_setrag(struct Doc *doc);
 
  /*
   * html_setshowstyle
   *  print debugging info when styles are created
   */
-void html_setshowstyle();
+void html_setshowstyle(struct Doc *doc);
 
  /*
   * html_printtail
   *  prints the end of the html file
   */
-void html_printtail(FILE *file);
+void html_printtail(struct Sink *sink);
 
  /*
   * parstylestr
@@ -87,14 +89,20 @@ char *html_parstylestr(enum para_style style);
 
  /*
   * html_setdefaultfont
-  *  sets the default font for document -- printstr format Atom, ie Times-12
+  *  sets the default font for document, a font index as returned by font_printindex
   */
-void html_setdefaultfont(struct Atom *defaultfont);
+void html_setdefaultfont(struct Doc *doc, int defaultfont);
 
  /*
   * html_setabsolute
   *  use absolute font sizes in output, rather than relative (percentage)
   */
-void html_setabsolute();
+void html_setabsolute(struct Doc *doc);
+
+ /*
+  * html_free
+  *  frees the styles and fonts of the document
+  */
+void html_free(struct Doc *doc);
 
 #endif /* INCLUDED_HTML_H */ 
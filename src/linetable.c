@@ -68,73 +68,96 @@ void linetable_enumlines(struct array *texts, void *context, int (*proc)(void *c
     }
 }
 
-static struct array *lines = NULL;
-
  /*
   * saveline
-  *  add the current Text, index, and rect to the lines array
+  *  add the current Text, index, last index, and rect to the lines array
   */
 static int saveline(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
+    struct array *lines = (struct array *)context;
     struct Line line;
     line.text = cur;
     line.index = index;
     line.r = rect;
+    line.last = -1;
+    line.endsinpunc = 0;
     array_append_element(lines, &line);
     return 1;
 }
 
  /*
   * addempty
-  *  add an empty Line struct at the end of the lines array.
+  *  add an empty Line struct at the end of the lines array, past its length.
   */
-static void addempty() {
+static void addempty(struct array *lines) {
     struct Line line = {0};
     int length = array_length(lines);
     array_append_element(lines, &line);
     array_setlength(lines, length);
 }
 
+ /*
+  * linetable_init
+  *  returns an empty line table
+  */
+struct array *linetable_init() {
+    struct array *lines = array_init(sizeof(struct Line), 0);
+    addempty(lines);
+    return lines;
+}
 
  /*
-  * linetable_enum_linetable
-  *  enumerate the lines in the XML document.
-  *  if save is 1, then remember the line table for the next iteration. 
-  *  if save is 1, and there is a previous line table, use it.
-  *  if save is 0, then empty line table.
-  *  proc gets a context pointer, the current and next Line structs.
-  *  if proc returns 0, end enumeration
+  * linetable_create
+  *  returns the line table of texts, which must be sorted already. the last index
+  *  of each line and whether its last text ends in punctuation are filled in.
   */
-void linetable_enum_linetable(struct array *texts, void *context, int save, int (*proc)(void *context, struct Line *cur, struct Line *next)) {
-    int i, length, last, ret;
-    struct Line *cur = NULL, *next = NULL;
-    struct Line lastline = {0};
-    if (!lines)
-	lines = array_init(sizeof(struct Line), 0);
-    length = array_length(lines);
-    if (!length) {
-	linetable_enumlines(texts, NULL, saveline);
-	addempty();
-    }
+struct array *linetable_create(struct array *texts) {
+    struct array *lines = array_init(sizeof(struct Line), 0);
+    struct Line *line;
+    int i, length, textcount = array_length(texts);
+    
+    linetable_enumlines(texts, lines, saveline);
     length = array_length(lines);
-    last = length - 1;
-    lastline.index = array_length(texts);
     for (i = 0; i < length; i++) {
-	if (!cur)
-	    cur = array_elementat(lines, i);
-	if (!next) {
-	    if (i < last)
-		next = array_elementat(lines, i+1);
-	    else
-		next = &lastline;
-	}
-	ret = proc(context, cur, next);
-	cur = next;
-	next = NULL;
-	if (!ret)
-	    break;
+	line = array_elementat(lines, i);
+	line->last = ((i < length - 1) ? line[1].index : textcount) - 1;
+	line->endsinpunc = text_endsinpunc(array_elementat(texts, line->last));
     }
-    if (!save)
-	array_setlength(lines, 0);
+    addempty(lines);
+    return lines;
 }
 
+ /*
+  * linetable_append
+  *  append the lines of from to lines, offset is added to the text indexes
+  */
+void linetable_append(struct array *lines, struct array *from, int offset) {
+    int i, length = array_length(from);
+    for (i = 0; i < length; i++) {
+	struct Line line = *(struct Line *)array_elementat(from, i);
+	line.index += offset;
+	line.last += offset;
+	array_append_element(lines, &line);
+    }
+    addempty(lines);
+}
 
+ /*
+  * linetable_enum
+  *  enumerate the lines of a line table.
+  *  proc gets a context pointer, the current and next Line structs. the next Line
+  *  of the last line is empty, except for its index which is textcount.
+  *  if proc returns 0, end enumeration
+  */
+void linetable_enum(struct array *lines, int textcount, void *context, int (*proc)(void *context, struct Line *cur, struct Line *next)) {
+    int i, length = array_length(lines);
+    struct Line *first, lastline = {0};
+    
+    if (!length)
+	return;
+    first = array_elementat(lines, 0);
+    lastline.index = textcount;
+    for (i = 0; i < length; i++) {
+	if (!proc(context, first + i, (i < length - 1) ? first + i + 1 : &lastline))
+	    break;
+    }
+}
@@ -26,9 +26,11 @@
 struct array;
 struct Text;
 struct Line {
-    struct Text *text;
-    int index;
-    struct Rect r;
+    struct Text *text;		/* first text of the line */
+    int index;			/* index of the first text */
+    int last;			/* index of the last text */
+    int endsinpunc;		/* 1 if the last text ends in punctuation */
+    struct Rect r;		/* bounds of the texts of the line */
 };
 
  /*
@@ -40,14 +42,31 @@ struct Line {
 void linetable_enumlines(struct array *texts, void *context, int (*proc)(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex));
 
  /*
-  * linetable_enum_linetable
-  *  enumerate the lines in the XML document.
-  *  if save is 1, then remember the line table for the next iteration. 
-  *  if save is 1, and there is a previous line table, use it.
-  *  if save is 0, then empty line table.
-  *  proc gets a context pointer, the current and next Line structs.
+  * linetable_init
+  *  returns an empty line table
+  */
+struct array *linetable_init();
+
+ /*
+  * linetable_create
+  *  returns the line table of texts, which must be sorted already. the table is 
+  *  followed by an empty Line, so the Line after the last one can be looked at.
+  */
+struct array *linetable_create(struct array *texts);
+
+ /*
+  * linetable_append
+  *  append the lines of from to lines, offset is added to the text indexes
+  */
+void linetable_append(struct array *lines, struct array *from, int offset);
+
+ /*
+  * linetable_enum
+  *  enumerate the lines of a line table.
+  *  proc gets a context pointer, the current and next Line structs. the next Line
+  *  of the last line is empty, except for its index which is textcount.
   *  if proc returns 0, end enumeration
   */
-void linetable_enum_linetable(struct array *texts, void *context, int save, int (*proc)(void *context, struct Line *cur, struct Line *next));
+void linetable_enum(struct array *lines, int textcount, void *context, int (*proc)(void *context, struct Line *cur, struct Line *next));
 
 #endif /* INCLUDED_LINETABLE_H */
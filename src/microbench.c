@@ -0,0 +1,365 @@
+/*
+ * microbench.c
+ *
+ * Copyright (C) 2010 Pranananda Deva
+ *
+ * This file is part of pdfreflow.
+ *
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * microbench times the building blocks of pdfreflow on their own: the
+  * hashtable, the array and the text classifiers, in ns and allocations per
+  * operation. built with make microbench. allocations are counted by linking
+  * with ld --wrap for malloc, calloc, realloc and strdup.
+  */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include "hashtable.h"
+#include "array.h"
+#include "text.h"
+
+static unsigned long allocs;	/* allocations since the start */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocs++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *str) {
+    allocs++;
+    return __real_strdup(str);
+}
+
+ /*
+  * Result
+  *  the best of the runs of a benchmark
+  */
+struct Result {
+    const char *name;
+    double ns;			/* per operation, of the fastest run */
+    double allocs;		/* per operation, of the same run */
+};
+
+#define MAXRESULTS 32
+
+static struct Result results[MAXRESULTS];
+static int nresults;
+
+ /*
+  * Timer
+  *  the time and allocations of the operations measured, paused around setup
+  */
+static struct Timer {
+    double start;
+    double elapsed;
+    unsigned long startallocs;
+    unsigned long allocs;
+} timer;
+
+static volatile int result;	/* keeps the calls from being optimized away */
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void timer_resume() {
+    timer.startallocs = allocs;
+    timer.start = now();
+}
+
+static void timer_pause() {
+    timer.elapsed += now() - timer.start;
+    timer.allocs += allocs - timer.startallocs;
+}
+
+static void begin() {
+    memset(&timer, 0, sizeof(timer));
+    timer_resume();
+}
+
+ /*
+  * end
+  *  stop the timer and record ops operations of the benchmark name. the
+  *  allocations kept are those of the run whose time is kept
+  */
+static void end(const char *name, long ops) {
+    struct Result *cur;
+    double ns;
+    int i;
+
+    timer_pause();
+    ns = timer.elapsed / ops;
+    for (i = 0; i < nresults && strcmp(results[i].name, name); i++);
+    cur = results + i;
+    if (i == nresults) {
+	if (nresults == MAXRESULTS)
+	    return;
+	nresults++;
+	cur->name = name;
+    } else if (ns >= cur->ns)
+	return;
+    cur->ns = ns;
+    cur->allocs = (double)timer.allocs / ops;
+}
+
+ /*
+  * makekeys
+  *  returns n distinct string keys, starting with prefix
+  */
+static char **makekeys(const char *prefix, int n) {
+    char **keys = malloc((size_t)n * sizeof(char *));
+    char buf[32];
+    int i;
+    for (i = 0; i < n; i++) {
+	sprintf(buf, "%s%d", prefix, i);
+	keys[i] = strdup(buf);
+    }
+    return keys;
+}
+
+static void freekeys(char **keys, int n) {
+    int i;
+    for (i = 0; i < n; i++)
+	free(keys[i]);
+    free(keys);
+}
+
+ /*
+  * benchhashtable
+  *  put, get and remove n keys. pointer keys are the addresses of n objects
+  *  the size of a struct Text, as the pagestarts table has
+  */
+static void benchhashtable(int n, int pointers) {
+    char **keys, **misses;
+    char *objects = NULL;
+    struct hashtable *table;
+    int i;
+
+    if (!pointers) {
+	keys = makekeys("font-family:", n);
+	misses = makekeys("missing:", n);
+    } else {
+	keys = malloc((size_t)n * sizeof(char *));
+	misses = malloc((size_t)n * sizeof(char *));
+	objects = malloc((size_t)n * 48);
+	for (i = 0; i < n; i++) {
+	    keys[i] = objects + (size_t)i * 48;
+	    misses[i] = objects + (size_t)i * 48 + 8;
+	}
+    }
+    table = hashtable_create(0);
+    if (pointers)
+	hashtable_set_keys_are_pointers(table);
+
+    begin();
+    for (i = 0; i < n; i++)
+	hashtable_put(table, keys[i], keys);
+    end(pointers ? "hashtable_put pointer" : "hashtable_put string", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += hashtable_get(table, keys[i]) != NULL;
+    end(pointers ? "hashtable_get pointer hit" : "hashtable_get string hit", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += hashtable_get(table, misses[i]) != NULL;
+    end(pointers ? "hashtable_get pointer miss" : "hashtable_get string miss", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	hashtable_remove(table, keys[i]);
+    end(pointers ? "hashtable_remove pointer" : "hashtable_remove string", n);
+
+    hashtable_free(table);
+    if (pointers) {
+	free(objects);
+	free(keys);
+	free(misses);
+    } else {
+	freekeys(keys, n);
+	freekeys(misses, n);
+    }
+}
+
+#define SEARCHLENGTH 256	/* length of the arrays searched */
+
+ /*
+  * bencharray
+  *  append n ints, and find and remove elements of arrays of
+  *  SEARCHLENGTH pointers, as the lists of styles and fonts are
+  */
+static void bencharray(int n) {
+    void *elements[SEARCHLENGTH];
+    struct array *array = array_init(sizeof(int), 0);
+    int i, j;
+
+    begin();
+    for (i = 0; i < n; i++)
+	array_append_element(array, &i);
+    end("array_append_element", n);
+    array_free(array);
+
+    array = array_pointer_init(0);
+    for (i = 0; i < SEARCHLENGTH; i++) {
+	elements[i] = elements + i;
+	array_append_element(array, elements[i]);
+    }
+    begin();
+    for (i = 0; i < n; i++)
+	result += array_element_index(array, elements[(i * 7) % SEARCHLENGTH]);
+    end("array_element_index", n);
+
+    /* remove in an order mixing the front, middle and end */
+    begin();
+    for (i = 0; i < n; i += SEARCHLENGTH) {
+	timer_pause();
+	array_setlength(array, 0);
+	for (j = 0; j < SEARCHLENGTH; j++)
+	    array_append_element(array, elements[j]);
+	timer_resume();
+	for (j = 0; j < SEARCHLENGTH; j++)
+	    array_remove_element(array, elements[(j * 7) % SEARCHLENGTH]);
+    }
+    end("array_remove_element", i);
+    array_free(array);
+}
+
+static char *samples[] = {
+    "The beginning of a paragraph ",
+    "and the end of a sentence. ",
+    "   ",
+    "<b>Chapter 1</b>",
+    "123 ",
+    " 45",
+    "&quot;Quoted&quot; ",
+    "does it end with a question? ",
+    "<i> </i>",
+    "said: ",
+    "“a quote” ",
+    "xiv"
+};
+#define SAMPLES ((int)(sizeof(samples) / sizeof(samples[0])))
+
+ /*
+  * benchtext
+  *  run the text classifiers n times over texts like those of a book
+  */
+static void benchtext(int n) {
+    struct Text *texts[SAMPLES];
+    int i;
+
+    for (i = 0; i < SAMPLES; i++)
+	texts[i] = text_init(100, 72, 300, 12, 0, 10, samples[i], strlen(samples[i]));
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += text_endsinpunc(texts[i % SAMPLES]);
+    end("text_endsinpunc", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += text_startswithcap(texts[i % SAMPLES]);
+    end("text_startswithcap", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += text_isempty(texts[i % SAMPLES]);
+    end("text_isempty", n);
+
+    begin();
+    for (i = 0; i < n; i++)
+	result += text_numericvalue(texts[i % SAMPLES]);
+    end("text_numericvalue", n);
+
+    for (i = 0; i < SAMPLES; i++)
+	text_free(texts[i]);
+}
+
+static void usage(int retval) {
+    fprintf(stderr, "\n\
+usage: microbench [options]\n\
+Options:\n\
+  -n, --ops=N		operations per benchmark (default is 200000)\n\
+  -r, --runs=N		runs of each benchmark, the fastest is kept (default is 3)\n\
+  -h, --help		print this help\n\
+\n");
+    exit(retval);
+}
+
+struct option longopts[] = {
+    { "help",	    no_argument, NULL, 'h' },
+    { "ops",	    required_argument, NULL, 'n' },
+    { "runs",	    required_argument, NULL, 'r' },
+    {0}
+};
+
+ /*
+  * main - run the benchmarks and print the results
+  */
+int main(int argc, char **argv) {
+    int ch, i, ops = 200000, runs = 3;
+    while ((ch = getopt_long(argc, argv, "hn:r:", longopts, NULL)) != EOF) {
+	switch (ch) {
+	    case 'n':
+		ops = strtol(optarg, NULL, 10);
+		break;
+	    case 'r':
+		runs = strtol(optarg, NULL, 10);
+		break;
+	    case 'h':
+		usage(0);
+		break;
+	    default:
+		usage(1);
+		break;
+	}
+    }
+    if (optind < argc || ops < 1 || runs < 1)
+	usage(1);
+    for (i = 0; i < runs; i++) {
+	benchhashtable(ops, 0);
+	benchhashtable(ops, 1);
+	bencharray(ops);
+	benchtext(ops);
+    }
+    printf("%-30s %10s %10s\n", "benchmark", "ns/op", "allocs/op");
+    for (i = 0; i < nresults; i++)
+	printf("%-30s %10.1f %10.3f\n", results[i].name, results[i].ns, results[i].allocs);
+    return 0;
+}
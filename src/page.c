@@ -21,12 +21,16 @@
 
 #include <config.h>
 #include "page.h"
+#include "doc.h"
 #include "font.h"
 #include "html.h"
 #include "text.h"
 #include "hashtable.h"
 #include "array.h"
 #include "linetable.h"
+#include "histogram.h"
+#include "sink.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,24 +45,13 @@ struct Page {
     int dontreflow;	    /* 1 if user specified page to not be reflowed */
     struct Text *pageno;    /* text that contains the page number */
     struct array *texts;    /* array of text objects */
+    struct array *lines;    /* line table, built once the texts are sorted */
     struct Rect r;	    /* cached textbounds */
     int pageleft;	    /* set of leftmost x pos, when there are multiple lines */
+    struct Doc *doc;	    /* document holding the page */
 };
 
-static int page_delta = -1;		    /* diff between real and printed page number */
-static int page_first = -1;		    /* first page with a detected page number */
-static int page_last = -1;		    /* last page with a detected page number */
-static int page_mintop = -1;		    /* min y position used for cropping */
-static int page_maxtop = -1;		    /* max y position used for cropping */
-static int page_rag = 0;		    /* paragraphs contain rag-right text (vs justified) */
-static int page_lineheight = 15;	    /* ordinary line height, most used in document */
-static int page_lineleading = -1;	    /* ordinary line leading, most used in document */
-static int page_showpara = 0;		    /* show debugging paragraph info */
-static struct array *pageranges = NULL;	    /* used for --dontreflow option */
 struct Rect page_setminbounds(struct Rect a, struct Rect min);	/* mimimum valid page bounds */
-static int page_center = -1;
-static int page_nonfiction = 0;
-static int page_shortlines = 0;
 #define CDELTA 20			    /* inset from margins for centered text detection */
 
 struct PageRange {
@@ -70,37 +63,37 @@ struct PageRange {
   * page_setshowpara
   *  debugging option --showpara
   */
-void page_setshowpara() {
-    page_showpara = 1;
+void page_setshowpara(struct Doc *doc) {
+    doc->page_showpara = 1;
 }
 
  /*
   * page_setnonfiction
   *  text does not have a lot of dialog, not dependent on indent
   */
-void page_setnonfiction() {
-    page_nonfiction = 1;
+void page_setnonfiction(struct Doc *doc) {
+    doc->page_nonfiction = 1;
 }
 
  /*
   * page_setshortlines
   *  break paragraphs on short lines
   */
-void page_setshortlines(int percent) {
-    page_shortlines = percent;
+void page_setshortlines(struct Doc *doc, int percent) {
+    doc->page_shortlines = percent;
 }
 
  /*
   * checkreflow
   *  check to see if number is among the dontreflow page ranges
   */
-static int checkreflow(int number) {
+static int checkreflow(struct Doc *doc, int number) {
     int length;
     struct PageRange *first, *last, *cur;
-    if (!pageranges)
+    if (!doc->pageranges)
 	return 0;
-    length = array_length(pageranges);
-    first = array_elementat(pageranges, 0);
+    length = array_length(doc->pageranges);
+    first = array_elementat(doc->pageranges, 0);
     last = first + length;
     for (cur = first; cur < last; cur++) {
 	if (number >= cur->first && number <= cur->last)
@@ -113,7 +106,7 @@ static int checkreflow(int number) {
   * checkdash
   *  look for a dash separated page range in the --dontreflow option
   */
-static void checkdash(char *cur) {
+static void checkdash(struct Doc *doc, char *cur) {
     char *dash = strchr(cur, '-');
     struct PageRange pr;
     if (dash) {
@@ -124,7 +117,7 @@ static void checkdash(char *cur) {
 	pr.first = strtol(cur, NULL, 10);
 	pr.last = pr.first;
     }
-    array_append_element(pageranges, &pr);
+    array_append_element(doc->pageranges, &pr);
 }
 
  /*
@@ -132,56 +125,67 @@ static void checkdash(char *cur) {
   *  parse page ranges for --dontreflow option, ie "1-3,4,10, 99-102"
   *  very strict about input, no accomodation for whitespace
   */
-void setPageRange(char *range) {
+void setPageRange(struct Doc *doc, char *range) {
     char *cur = range, *comma = NULL;
     
-    pageranges = array_init(sizeof(struct PageRange), 0);
+    page_freeranges(doc);
+    doc->pageranges = array_init(sizeof(struct PageRange), 0);
     while ((comma = strchr(cur, ','))) {
 	*comma = 0;
-	checkdash(cur);
+	checkdash(doc, cur);
 	cur = comma + 1;
     }
-    checkdash(cur);
+    checkdash(doc, cur);
+}
+
+ /*
+  * page_freeranges
+  *  frees the page ranges of the --dontreflow option
+  */
+void page_freeranges(struct Doc *doc) {
+    if (doc->pageranges)
+	array_free(doc->pageranges);
+    doc->pageranges = NULL;
 }
 
  /*
   * page_setlineleading
   *  sets the most common line leading in document
   */
-void page_setlineleading(int leading) {
-    page_lineleading = leading;
+void page_setlineleading(struct Doc *doc, int leading) {
+    doc->page_lineleading = leading;
 }
 
  /*
   * page_setlineheight
   *  sets the most common lineheight in document
   */
-void page_setlineheight(int lineheight) {
-    page_lineheight = lineheight;
+void page_setlineheight(struct Doc *doc, int lineheight) {
+    doc->page_lineheight = lineheight;
 }
 
  /*
   * page_setrag
   *  set no-justify, or rag-right
   */
-void page_setrag() {
-    page_rag = 1;
-    html_setrag();
+void page_setrag(struct Doc *doc) {
+    doc->page_rag = 1;
+    html_setrag(doc);
 }
  /*
   * page_cropbottom
   *  crop text objects whose top is greater than or equal to "cropbottom"
   */
-void page_cropbottom(int cropbottom) {
-    page_maxtop = cropbottom;
+void page_cropbottom(struct Doc *doc, int cropbottom) {
+    doc->page_maxtop = cropbottom;
 }
 
  /*
   * page_croptop
   *  crop text objects whose top is less than  or equal to "croptop"
   */
-void page_croptop(int croptop) {
-    page_mintop = croptop;
+void page_croptop(struct Doc *doc, int croptop) {
+    doc->page_mintop = croptop;
 }
 
  /*
@@ -208,7 +212,7 @@ struct array_procs page_procs = {
   * page_init
   *  create a page object
   */
-struct Page *page_init(int number, int width, int height) {
+struct Page *page_init(struct Doc *doc, int number, int width, int height) {
     struct Page *page = calloc(1, sizeof(struct Page));
     if (page) {
 	page->number = number;
@@ -220,7 +224,8 @@ struct Page *page_init(int number, int width, int height) {
 	page->pageno = 0;
 	page->texts = array_special_init(&page_procs, 0, NULL);
 	array_set_contains_pointers(page->texts, 1);
-	page->dontreflow = checkreflow(number);
+	page->doc = doc;
+	page->dontreflow = checkreflow(doc, number);
     }
     return page;
 }
@@ -232,6 +237,8 @@ struct Page *page_init(int number, int width, int height) {
   */
 void page_free(struct Page *page) {
     array_free(page->texts);
+    if (page->lines)
+	array_free(page->lines);
     free(page);
 }
 
@@ -265,14 +272,15 @@ void page_addtext(struct Page *page, struct Text *text) {
   */
 static void printval(struct Page *page, struct Text *text, int index, int print) {
     int val = text_numericvalue(text);
-    if (page_delta < 0) {
-	page_delta = page->number - val;
-	page_first = page->number;
+    struct Doc *doc = page->doc;
+    if (doc->page_delta < 0) {
+	doc->page_delta = page->number - val;
+	doc->page_first = page->number;
     }
-    page_last = page->number;
+    doc->page_last = page->number;
     page->pageno = text;
     if (print)
-	fprintf(stderr, "page %d displays page number %d (%d of %d).\n", page->number, val, index, array_length(page->texts));
+	sink_printf(doc->diag, "page %d displays page number %d (%d of %d).\n", page->number, val, index, array_length(page->texts));
 }
 
  /*
@@ -280,7 +288,7 @@ static void printval(struct Page *page, struct Text *text, int index, int print)
   *  prints the an error for when no page number is detected
   */
 static void page_nopagenumber(struct Page *page) {
-    fprintf(stderr, "page %d has no page number.\n", page->number);
+    sink_printf(page->doc->diag, "page %d has no page number.\n", page->number);
 }
 
  /*
@@ -363,8 +371,8 @@ enum textenum_ret contains_page_no(struct Page *page, void *p, struct Text *cur)
 	/* if there is a valid page_delta value, use it to further check for 
 	 * a reasonable page number range
 	 */
-	if (page_delta > 0) {
-	    if (val >= (page->number - page_delta)) {
+	if (page->doc->page_delta > 0) {
+	    if (val >= (page->number - page->doc->page_delta)) {
 		return textenum_stop_with_results;
 	    } else {
 		return textenum_stop_no_results;
@@ -428,12 +436,6 @@ void page_printpageno(struct Page *page) {
     page_findpageno(page, 1);
 }
 
- /*
-  * linematches
-  *  stores text object that are on the same line as a detected page number (header/footers usually)
-  */
-static struct array *linematches = NULL;
-
  /*
   * page_removepageno
   *  remove entire header/footer that contains the page number
@@ -441,12 +443,13 @@ static struct array *linematches = NULL;
 static void page_removepageno(struct Page *page) {
     int i, length;
     struct Text *text;
+    struct Doc *doc = page->doc;
+    struct array *linematches;	/* texts on the same line as the page number, or cropped */
     if (page->removedpageno)
 	return;
     if (!page->pageno)
 	page_findpageno(page, 0);
-    if (!linematches)
-	linematches = array_pointer_init(0);
+    linematches = array_pointer_init(0);
     if (page->pageno) {
 	length = array_length(page->texts);
 	for (i = 0; i < length; i++) {
@@ -463,15 +466,15 @@ static void page_removepageno(struct Page *page) {
 	array_setlength(linematches, 0);
     }
     /* crop texts that are less that mintop and greater than maxtop */
-    if (page_mintop >= 0 || page_maxtop >= 0) {
+    if (doc->page_mintop >= 0 || doc->page_maxtop >= 0) {
 	length = array_length(page->texts);
 	for (i = 0; i < length; i++) {
 	    int top;
 	    text = array_elementat(page->texts, i);
 	    top = text_top(text);
-	    if (top <= page_mintop)
+	    if (top <= doc->page_mintop)
 		array_append_element(linematches, text);
-	    else if (page_maxtop >= 0 && top >= page_maxtop)
+	    else if (doc->page_maxtop >= 0 && top >= doc->page_maxtop)
 		array_append_element(linematches, text);
 	}
 	length = array_length(linematches);
@@ -481,18 +484,77 @@ static void page_removepageno(struct Page *page) {
 	}
 	array_setlength(linematches, 0);
     }
-    length = array_length(page->texts);
+    array_free(linematches);
     page->removedpageno = 1;
 }
 
  /*
-  * textcompare
-  *  qsort comparison proc
+  * struct SortKey
+  *  a text and its packed sort key, for page_sort
+  */
+struct SortKey {
+    unsigned long long key;
+    struct Text *text;
+};
+
+#define KEYBITS 20			/* bits for a position in a sort key */
+#define KEYMAX ((1 << KEYBITS) - 1)
+
+ /*
+  * packkey
+  *  packs major, then x, then y into a key. x and y are relative to the
+  *  top left of the page.
   */
-static int textcompare(const void *p1, const void *p2) {
-    struct Text **s1 = (struct Text **)p1;
-    struct Text **s2 = (struct Text **)p2;
-    return text_compare(*s1, *s2);
+static unsigned long long packkey(int major, int x, int y) {
+    if (x < 0) x = 0;
+    if (x > KEYMAX) x = KEYMAX;
+    if (y < 0) y = 0;
+    if (y > KEYMAX) y = KEYMAX;
+    return ((unsigned long long)major << (2 * KEYBITS)) | ((unsigned long long)x << KEYBITS) | y;
+}
+
+ /*
+  * sortkeys
+  *  stable sort of keys by key. Short arrays use an insertion sort, others an
+  *  LSD radix sort on bytes, skipping bytes that are the same in all keys.
+  *  tmp has room for length keys.
+  */
+static void sortkeys(struct SortKey *keys, struct SortKey *tmp, int length) {
+    struct SortKey *src = keys, *dst = tmp, *swap;
+    int counts[256];
+    int i, shift;
+    if (length < 64) {
+	for (i = 1; i < length; i++) {
+	    struct SortKey cur = keys[i];
+	    int j = i - 1;
+	    while (j >= 0 && keys[j].key > cur.key) {
+		keys[j + 1] = keys[j];
+		j--;
+	    }
+	    keys[j + 1] = cur;
+	}
+	return;
+    }
+    for (shift = 0; shift < 64; shift += 8) {
+	int sum = 0;
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < length; i++)
+	    counts[(src[i].key >> shift) & 0xff]++;
+	if (counts[(src[0].key >> shift) & 0xff] == length)
+	    continue;
+	for (i = 0; i < 256; i++) {
+	    int count = counts[i];
+	    counts[i] = sum;
+	    sum += count;
+	}
+	for (i = 0; i < length; i++)
+	    dst[counts[(src[i].key >> shift) & 0xff]++] = src[i];
+	swap = src;
+	src = dst;
+	dst = swap;
+    }
+    if (src != keys)
+	memcpy(keys, src, length * sizeof(struct SortKey));
 }
 
  /*
@@ -500,13 +562,12 @@ static int textcompare(const void *p1, const void *p2) {
   *  remove all the empty text objects from the page
   */
 static void removeempties(struct Page *page) {
-    static struct array *empties = NULL;
+    struct array *empties;
     int i, length;
     
     if (page->removedempties)
 	return;
-    if (!empties)
-	empties = array_pointer_init(0);
+    empties = array_pointer_init(0);
     length = array_length(page->texts);
     for (i = 0; i < length; i++) {
 	struct Text *text = array_elementat(page->texts, i);
@@ -518,7 +579,7 @@ static void removeempties(struct Page *page) {
 	struct Text *text = array_elementat(empties, i);
 	array_remove_element(page->texts, text);
     }
-    array_setlength(empties, 0);
+    array_free(empties);
     page->removedempties = 1;
 }
 
@@ -530,16 +591,67 @@ void page_sort(struct Page *page) {
     removeempties(page);
     page_removepageno(page);
     if (!page->sorted) {
-	int length;
+	int i, line, length, mintop, minleft;
+	struct SortKey *keys, *tmp;
+	struct Text *anchor, **texts;
 	
 	length = array_length(page->texts);
-	array_set_contains_pointers(page->texts, 0);
-	qsort(array_elementat(page->texts, 0), length, sizeof(char *), textcompare);
-	array_set_contains_pointers(page->texts, 1);
+	if (length > 1) {
+	    keys = malloc(2 * length * sizeof(struct SortKey));
+	    tmp = keys + length;
+	    mintop = minleft = 0;
+	    for (i = 0; i < length; i++) {
+		struct Rect r = text_rect(array_elementat(page->texts, i));
+		if (!i || r.top < mintop)
+		    mintop = r.top;
+		if (!i || r.left < minleft)
+		    minleft = r.left;
+	    }
+	    /* top to bottom */
+	    for (i = 0; i < length; i++) {
+		struct Text *text = array_elementat(page->texts, i);
+		struct Rect r = text_rect(text);
+		keys[i].key = packkey(0, r.top - mintop, r.left - minleft);
+		keys[i].text = text;
+	    }
+	    sortkeys(keys, tmp, length);
+	    /* 
+	     * texts on the same line as the first text of the line (by baseline,
+	     * or by overlapping vertically) are put in its line
+	     */
+	    line = 0;
+	    anchor = keys[0].text;
+	    for (i = 0; i < length; i++) {
+		struct Text *text = keys[i].text;
+		struct Rect r = text_rect(text);
+		if (i && !text_intersects(anchor, text)) {
+		    line++;
+		    anchor = text;
+		}
+		keys[i].key = packkey(line, r.left - minleft, r.top - mintop);
+	    }
+	    /* lines top to bottom, texts in a line left to right */
+	    sortkeys(keys, tmp, length);
+	    texts = array_getdata(page->texts);
+	    for (i = 0; i < length; i++)
+		texts[i] = keys[i].text;
+	    free(keys);
+	}
 	page->sorted = 1;
     }
 }
 
+ /*
+  * page_lines
+  *  returns the line table of a sorted page, it is built the first time
+  */
+static struct array *page_lines(struct Page *page) {
+    page_sort(page);
+    if (!page->lines)
+	page->lines = linetable_create(page->texts);
+    return page->lines;
+}
+
 struct PageStats {
     int left;
     int hitsleft;
@@ -580,52 +692,27 @@ struct Rect page_textbounds(struct Page *page) {
     }
     page->r = r;
     stats.left = r.left;
-    linetable_enum_linetable(page->texts, &stats, 0, countlines);
+    linetable_enum(page_lines(page), length, &stats, countlines);
     if (stats.hitsleft > 1 && stats.hitsleft > (stats.nlines/10))
 	page->pageleft = r.left;
     return r;
 }
 
- /*
-  * put_int
-  *  if leading exists in hashtable, increment value. 
-  *  if force, then alway increment
-  *  returns 1 if successful, 0 if nothing happened
-  */
-int put_int(struct hashtable *hash, int leading, int force) {
-    int oldval = (int)hashtable_get(hash, (void *) leading);
-    if (oldval || force) {
-	oldval++;
-	hashtable_put(hash, (void *) leading, (void *)oldval);
-	return 1;
-    }
-    return 0;
-}
-
-
- /*
-  * page_enumlines
-  *  sorts before calling linetable_enumlines
-  */
-static void page_enumlines(struct Page *page, void *context, int (*proc)(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex)) {
-    page_sort(page);
-    linetable_enumlines(page->texts, context, proc);
-}
-
 struct FindCenter {
+    struct Doc *doc;
     int curline;
     int lineno;
 };
 
  /*
   * findcenter
-  *  callback of page_enumlines, to discover the page_center used for discovering centered 
+  *  callback of linetable_enum, to discover the page_center used for discovering centered 
   *  lines.
   */
-static int findcenter(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
+static int findcenter(void *context, struct Line *cur, struct Line *next) {
     struct FindCenter *info = (struct FindCenter *)context;
     if (info->curline == info->lineno) {
-	page_center = rect.left + (rect.width/2);
+	info->doc->page_center = cur->r.left + (cur->r.width/2);
 	return 0;
     }
     info->curline++;
@@ -638,118 +725,58 @@ static int findcenter(void *context, struct Text *cur, struct Text *next, struct
   */
 void page_setcenter(struct Page *page, int lineno) {
     struct FindCenter info = {0};
-    page_enumlines(page, &info, findcenter);
+    info.doc = page->doc;
+    linetable_enum(page_lines(page), page_length(page), &info, findcenter);
 }
 
-struct Leading {
-    int bias;
-    struct hashtable *hash;
+ /*
+  * LayoutInfo
+  *  context of getlayout
+  */
+struct LayoutInfo {
+    struct Doc *doc;
+    struct Layout *layout;
 };
 
  /*
-  * getleadings
-  *  called back to calc leading and store in hash table. some hacking here to 
-  *  match approximate values, since there seems to be some off-by-one noise
-  *  in some poorly formatted PDF files 
+  * getlayout
+  *  called back for each line to record left, right, font size, line height
+  *  and leading in one pass. some hacking here to match approximate leading
+  *  values, since there seems to be some off-by-one noise in some poorly
+  *  formatted PDF files
   */
-static int getleadings(void *context, struct Line *cur, struct Line *next) {
-    struct Leading *info = (struct Leading *) context;
+static int getlayout(void *context, struct Line *cur, struct Line *next) {
+    struct LayoutInfo *info = (struct LayoutInfo *) context;
+    struct Layout *layout = info->layout;
     int leading;
     
+    histogram_add(layout->left, cur->r.left);
+    histogram_add(layout->right, rect_right(cur->r));
+    histogram_add(layout->fontsize, font_printindex(info->doc, text_font(cur->text)));
+    histogram_add(layout->lineheight, text_height(cur->text));
     if (!next)
 	return 1;
-    leading = info->bias + (next->r.top - cur->r.top) - cur->r.height;
+    leading = layout->bias + (next->r.top - cur->r.top) - cur->r.height;
     if (leading > 0)
-	put_int(info->hash, leading, 1);
-    return 1;
-}
-
- /*
-  * getleft
-  *  record the left pos of a text 
-  */
-static int getleft(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
-    struct hashtable *hash = (struct hashtable *)context;
-    put_int(hash, rect.left, 1);
-    return 1;
-}
-
- /*
-  * getright
-  *  record the right pos of a text 
-  */
-static int getright(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
-    struct hashtable *hash = (struct hashtable *)context;
-    put_int(hash, rect_right(rect), 1);
-    return 1;
-}
-
- /*
-  * getfontsize
-  *  record the font size info of a text 
-  */
-static int getfontsize(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
-    struct hashtable *hash = (struct hashtable *)context;
-    put_int(hash, (int)text_fontprintstr(cur), 1);
+	histogram_add(layout->leading, leading);
     return 1;
 }
 
  /*
-  * getlineheight
-  *  record the lineheight of a text 
-  */
-static int getlineheight(void *context, struct Text *cur, struct Text *next, struct Rect rect, int index, int nextindex) {
-    struct hashtable *hash = (struct hashtable *)context;
-    put_int(hash, (int)text_height(cur), 1);
-    return 1;
-}
-
- /*
-  * page_getleadings
-  *  place leading values into the hashtable. key=leading, val=count
-  */
-void page_getleadings(struct Page *page, struct hashtable *hash, int bias) {
-    struct Leading info;
-    page_sort(page);
-    info.hash = hash;
-    info.bias = bias;
-    linetable_enum_linetable(page->texts, &info, 0, getleadings);
-}
-
- /*
-  * page_getleft
-  *  place left positions of text objects into the hashtable. key=left, val=count
-  */
-void page_getleft(struct Page *page, struct hashtable *hash) {
-    page_enumlines(page, hash, getleft);
-}
-
- /*
-  * page_getright
-  *  place right positions of text objects into the hashtable. key=right, val=count
-  */
-void page_getright(struct Page *page, struct hashtable *hash) {
-    page_enumlines(page, hash, getright);
-}
-
- /*
-  * page_getfontsize
-  *  place font sizes of text objects into the hashtable. key=fontsize, val=count
+  * page_getlayout
+  *  place left, right, font size, line height and leading values of the lines
+  *  of the page into the histograms of layout
   */
-void page_getfontsize(struct Page *page, struct hashtable *hash) {
-    page_enumlines(page, hash, getfontsize);
-}
-
- /*
-  * page_getlineheight
-  *  place line height of text objects into the hashtable. key=height, val=count
-  */
-void page_getlineheight(struct Page *page, struct hashtable *hash) {
-    page_enumlines(page, hash, getlineheight);
+void page_getlayout(struct Page *page, struct Layout *layout) {
+    struct LayoutInfo info;
+    info.doc = page->doc;
+    info.layout = layout;
+    linetable_enum(page_lines(page), page_length(page), &info, getlayout);
 }
 
 
 struct para_info {
+    struct Doc *doc;		    /* document being reflowed */
     int lineno;			    /* current line number */
     int startpara;		    /* line number of the start of paragarph */
     struct Line *startline;	    /* Line struct at start of paragraph */
@@ -772,9 +799,21 @@ struct para_info {
     int dontprint;		    /* set to 1 when nothing is to be printed  */
     int printerr;		    /* set to 1 when nothing is to be printed to stderr */
     int notestyle;		    /* 1 when styles are to be recorded with the html output */
-    int printstyle;		    /* 1 when styles are to be written as html output */
     int dontreflow;    		    /* 1 when current page is not to be reflowed */
-    FILE *file;			    /* output file for generated HTML */
+    struct array *paras;	    /* when set, paragraphs are recorded here for printing */
+};
+
+ /*
+  * Para
+  *  a paragraph found by findpara, recorded so the html can be printed after the styles
+  */
+struct Para {
+    struct Line *startline;	    /* first line of the paragraph, in the saved line table */
+    int endindex;		    /* index of the last text object of the paragraph */
+    enum para_style style;	    /* style of the paragraph */
+    struct Rect r;		    /* bounding rect of the paragraph */
+    int other;			    /* indent or outdent of the paragraph */
+    struct Rect bounds;		    /* bounds of the text objects of the page */
 };
 
   /*
@@ -787,24 +826,20 @@ static int approx_match(int pos1, int pos2, int delta) {
     return 0;
 }
 
-static int page_indentleft = -1;    /* x position of an indent (only 1 per doc) */
-static int page_outdentleft = -1;   /* x position of an outdent (2nd line of paragraph) */
-static int page_prevstyle = -1;	    /* style of previous paragraph */
-
   /*
   * normalheight
   *  returns 1 if height is most likely part of a paragraph 
   */
-static int normalheight(int height) {
-    return (height <= ((page_lineheight*5)/4));
+static int normalheight(struct Doc *doc, int height) {
+    return (height <= ((doc->page_lineheight*5)/4));
 }
 
  /*
   * page_setindent
   *  sets the x pos an indented line
   */
-void page_setindent(int indent) {
-    page_indentleft = indent;
+void page_setindent(struct Doc *doc, int indent) {
+    doc->page_indentleft = indent;
 }
 
  /*
@@ -812,7 +847,7 @@ void page_setindent(int indent) {
   *  returns 1 if line is centered
   */
 static int iscentered(struct para_info *info, struct Rect r) {
-    int center = page_center;
+    int center = info->doc->page_center;
     int center1 = r.left + (r.width/2);
     
     if (center > 0 && approx_match(center, center1, 10))
@@ -827,7 +862,7 @@ static int iscentered(struct para_info *info, struct Rect r) {
   *  checks additionally for left and right x pos to be inset from text margins by CDELTA
   */
 static int strictcenter(struct para_info *info, struct Rect r) {
-    if (r.left < rect_max(page_indentleft + 2, (info->bounds.left + CDELTA)))
+    if (r.left < rect_max(info->doc->page_indentleft + 2, (info->bounds.left + CDELTA)))
 	return 0;
     if (rect_right(r) > (rect_right(info->bounds) - CDELTA))
 	return 0;
@@ -842,14 +877,14 @@ static int strictcenter(struct para_info *info, struct Rect r) {
 static void realcheckparastyle(struct para_info *info, struct Rect rect, int nextleft) {
     int curiscentered = strictcenter(info, rect);
     int firstiscentered = strictcenter(info, info->startline->r);
-    if (info->startline->r.left < rect.left && (!curiscentered && !firstiscentered) && normalheight(rect.height)) {
+    if (info->startline->r.left < rect.left && (!curiscentered && !firstiscentered) && normalheight(info->doc, rect.height)) {
 	info->style = align_outdent;
 	if (!approx_match(info->outdentright, rect_right(info->startline->r), 2))
 	    info->outdentright = rect_right(info->startline->r);
 	if (!approx_match(info->outdentleft, rect.left, 2))
 	    info->outdentleft = rect.left;
 	info->indentleft = info->startline->r.left;
-    } else if (info->startline->r.left > (rect.left + 3) && normalheight(rect.height)) {
+    } else if (info->startline->r.left > (rect.left + 3) && normalheight(info->doc, rect.height)) {
 	info->style = align_indent;
 	if (!approx_match(info->indentright, rect_right(info->startline->r), 2))
 	    info->indentright = rect_right(info->startline->r);
@@ -865,11 +900,11 @@ static void realcheckparastyle(struct para_info *info, struct Rect rect, int nex
 	info->style = align_center;
     else if (info->startline->r.left > info->bounds.left && rect_right(info->startline->r) < rect_right(info->bounds) && approx_match(info->startline->r.left, rect.left, 3))
 	info->style = align_blockquote;
-    if (info->style == align_indent && page_indentleft < 0) {
-	page_indentleft = info->startline->r.left;
+    if (info->style == align_indent && info->doc->page_indentleft < 0) {
+	info->doc->page_indentleft = info->startline->r.left;
     }
-    if (info->style == align_outdent && page_outdentleft < 0) {
-	page_outdentleft = rect.left;
+    if (info->style == align_outdent && info->doc->page_outdentleft < 0) {
+	info->doc->page_outdentleft = rect.left;
     }
 }
 /*
@@ -925,12 +960,12 @@ static void checkoneliner(struct para_info *info, struct Line *cur, struct Line
     if (info->dontreflow) {
 	info->style = align_left;
     } else if (approx_match(info->startline->r.left, info->bounds.left, 3)) {
-	if ((nextleft == info->bounds.left || nextleft < 0) && page_prevstyle == align_outdent && normalheight(cur->r.height))
+	if ((nextleft == info->bounds.left || nextleft < 0) && info->doc->page_prevstyle == align_outdent && normalheight(info->doc, cur->r.height))
 	    info->style = align_outdent;
 	else
 	    info->style = align_left;
-    } else if (info->startline->r.left == page_indentleft &&
-	normalheight(cur->r.height))
+    } else if (info->startline->r.left == info->doc->page_indentleft &&
+	normalheight(info->doc, cur->r.height))
 	info->style = align_indent;
     else if (info->startline->r.left > info->bounds.left && approx_match(rect_right(info->startline->r), rect_right(info->bounds), 3))
 	info->style = align_right;
@@ -950,14 +985,13 @@ static int endsinpunc(struct para_info *info, int nextindex) {
 }
 static int rightjustified(struct Rect r, struct Rect bounds) {
     return ((rect_right(r) == rect_right(bounds)) &&
-	    r.left > (rect_max(bounds.left, page_indentleft) + 30));
+	    r.left > (rect_max(bounds.left, info->doc->page_indentleft) + 30));
 
 }
   */
 
 static int haveshortlines(struct para_info *info, struct Line *cur, struct Line *next) {
-    struct Text *end = array_elementat(info->texts, next->index - 1);
-    if (text_startswithcap(next->text) && text_endsinpunc(end))
+    if (text_startswithcap(next->text) && cur->endsinpunc)
 	return 1;
     return 0;
 }
@@ -977,12 +1011,12 @@ static int atparaend(struct para_info *info, struct Line *cur, struct Line *next
     if (next->r.height < (cur->r.height - 1))
 	return 1;
     if (info->style == align_indent || info->style == align_left) {
-	if (next->r.left == page_indentleft && cur->r.left != page_indentleft)
+	if (next->r.left == info->doc->page_indentleft && cur->r.left != info->doc->page_indentleft)
 	    return 1;
 	if (next->r.left > (cur->r.left + 5))
 	    return 1;
 	right = rect_right(cur->r);
-	if (!page_rag && (right < (info->indentright - 10)))
+	if (!info->doc->page_rag && (right < (info->indentright - 10)))
 	    return haveshortlines(info, cur, next);
 	if (info->style == align_left && info->shortlines) {
 	    if (cur->r.width < info->shortlines)
@@ -998,7 +1032,7 @@ static int atparaend(struct para_info *info, struct Line *cur, struct Line *next
 	if (next->r.left < (cur->r.left - 2)) {
 	    return 1;
 	}
-	if (!page_rag && rect_right(cur->r) < (info->outdentright - 10))
+	if (!info->doc->page_rag && rect_right(cur->r) < (info->outdentright - 10))
 	    return 1;
     }
     if (info->style == align_right) {
@@ -1011,20 +1045,20 @@ static int atparaend(struct para_info *info, struct Line *cur, struct Line *next
     if (info->startpara == info->lineno) {
 	    
 	/* 2 indented lines next to each other */
-	if (cur->r.left == page_indentleft && next->r.left >= page_indentleft) {
-	    if (!page_nonfiction)
+	if (cur->r.left == info->doc->page_indentleft && next->r.left >= info->doc->page_indentleft) {
+	    if (!info->doc->page_nonfiction)
 		return 1;
 	    return haveshortlines(info, cur, next);
 	}
 	/* center line, but next is indent */
-	if ((normalheight(cur->r.height) && strictcenter(info, cur->r)) && (next->r.left == page_indentleft || next->r.left == info->bounds.left)) {
+	if ((normalheight(info->doc, cur->r.height) && strictcenter(info, cur->r)) && (next->r.left == info->doc->page_indentleft || next->r.left == info->bounds.left)) {
 	    return 1;
 	}
 	right = rect_right(cur->r);
 	/* a short line */
-	if (!page_rag && cur->r.left == info->bounds.left && right < (rect_right(info->bounds) - 20 ))
+	if (!info->doc->page_rag && cur->r.left == info->bounds.left && right < (rect_right(info->bounds) - 20 ))
 	    return haveshortlines(info, cur, next);
-	if (!page_rag && cur->r.left == page_indentleft && right < (rect_right(info->bounds) - 10 ))
+	if (!info->doc->page_rag && cur->r.left == info->doc->page_indentleft && right < (rect_right(info->bounds) - 10 ))
 	    return haveshortlines(info, cur, next);
 	/* a left, short line, when --shortlines=X option is specified */
 	if (cur->r.left == info->bounds.left && info->shortlines) {
@@ -1037,19 +1071,19 @@ static int atparaend(struct para_info *info, struct Line *cur, struct Line *next
 	if (rightjustified(r, info->bounds) && !rightjustified(next->r, info->bounds))
 	    return 1;
 */	    
-	if (page_prevstyle == align_outdent) {
+	if (info->doc->page_prevstyle == align_outdent) {
 	    if (cur->r.left == info->indentleft && next->r.left == info->indentleft) {
 		return haveshortlines(info, cur, next);
 	    }
 	}
 	/* cur is left justified, next is left, have outdent, could be 1 line outdent */
-	if (page_indentleft >= 0 && page_outdentleft >= 0) {
+	if (info->doc->page_indentleft >= 0 && info->doc->page_outdentleft >= 0) {
 	    if (cur->r.left == info->bounds.left && next->r.left == info->bounds.left)
 		if (haveshortlines(info, cur, next)) {
 		    struct Line *third = next + 1;
 		    if (!third->text)
 			return 1;
-		    if (third->r.left == page_outdentleft && !text_startswithcap(third->text))
+		    if (third->r.left == info->doc->page_outdentleft && !text_startswithcap(third->text))
 			return 1;
 		}
 	}
@@ -1063,8 +1097,8 @@ static int atparaend(struct para_info *info, struct Line *cur, struct Line *next
   */
 static void printpageheader(struct para_info *info) {
     if (info->lastseen) {
-	if (!info->dontprint && info->printerr && page_showpara)
-	    fprintf(stderr, "page %d:\n", info->lastseen->number);
+	if (!info->dontprint && info->printerr && info->doc->page_showpara)
+	    sink_printf(info->doc->diag, "page %d:\n", info->lastseen->number);
 	info->lastseen = NULL;
     }
 }
@@ -1091,28 +1125,19 @@ static int dontreflow(struct para_info *info, struct Text *next) {
   *  of cur and the bottom margin is greater than the lineheight, return 1.
   */
 static int atpageend(struct para_info *info, struct Line *cur, struct Line *next) {
-    struct Rect nextr = {0};
-    int nextindex = -1;
-    if (next) {
-	nextr = next->r;
-	nextindex = next->index;
-    }
+    struct Rect nextr = next->r;
     if (dontreflow(info, next->text))
 	return 1;
     if (nextr.top < cur->r.top) {
 	struct Rect r = cur->r;
-	struct Text *last;
-	if (nextindex < 0)
-	    nextindex = array_length(info->texts);
-	last = array_elementat(info->texts, nextindex - 1);
-	if (page_rag) {
-	    if (text_endsinpunc(last)) {
+	if (info->doc->page_rag) {
+	    if (cur->endsinpunc) {
 		return 1;
 	    }
 	} else {
 	    int oneliner = (info->startpara == info->lineno);
 	    int nextiscent = iscentered(info, nextr);
-	    if (text_endsinpunc(last)) {
+	    if (cur->endsinpunc) {
 		if (info->style == align_outdent && r.left == nextr.left)
 		    return 0;
 		if (info->style == align_indent && approx_match(nextr.left, info->bounds.left, 5))
@@ -1183,8 +1208,8 @@ static void printparatexts(struct para_info *info, struct Line *cur, struct Line
 	info->startpara -= (info->startlineno - 1);
 	info->paranum = 1;
     }
-    if (!info->dontprint && info->printerr && page_showpara)
-	fprintf(stderr, "  para %d: %d - %d, %s\n", info->paranum, info->startpara, info->lineno, html_parstylestr(info->style));
+    if (!info->dontprint && info->printerr && info->doc->page_showpara)
+	sink_printf(info->doc->diag, "  para %d: %d - %d, %s\n", info->paranum, info->startpara, info->lineno, html_parstylestr(info->style));
     r = paraboundingrect(info, index, nextindex, oneliner);
     switch (info->style) {
 	case align_indent:
@@ -1211,11 +1236,18 @@ static void printparatexts(struct para_info *info, struct Line *cur, struct Line
 	index = nextindex - 1;
     if (!info->dontprint) {
 	if (info->notestyle)
-	    html_notestyle(info->texts, info->startindex, index, info->style,
-		r, other, info->bounds.left, info->bounds.width);
-	if (info->printstyle)
-	    html_printtexts(info->file, info->texts, info->startline, index, info->style,
+	    html_notestyle(info->doc, info->texts, info->startindex, index, info->style,
 		r, other, info->bounds.left, info->bounds.width);
+	if (info->paras) {
+	    struct Para para;
+	    para.startline = info->startline;
+	    para.endindex = index;
+	    para.style = info->style;
+	    para.r = r;
+	    para.other = other;
+	    para.bounds = info->bounds;
+	    array_append_element(info->paras, &para);
+	}
     }
     if (info->lastseen && info->startpage != info->lastseen->number) {
 	int savedpage = info->lastseen->number;
@@ -1263,8 +1295,8 @@ static void checkcenter(struct para_info *info, struct Line *end) {
   * calcshortlines
   *  returns a percentage of the maximum width
   */
-static int calcshortlines(int width) {
-    return (width * page_shortlines) / 100;
+static int calcshortlines(struct Doc *doc, int width) {
+    return (width * doc->page_shortlines) / 100;
 }
 
  /*
@@ -1285,7 +1317,7 @@ static int findpara(void *context, struct Line *cur, struct Line *next) {
 	    }
 	    info->startlineno = info->lineno;
 	    info->bounds = page_setminbounds(page_textbounds(page), info->minbounds);
-	    info->shortlines = calcshortlines(info->bounds.width);
+	    info->shortlines = calcshortlines(info->doc, info->bounds.width);
 	}
     }
     if (next->text) {
@@ -1295,12 +1327,12 @@ static int findpara(void *context, struct Line *cur, struct Line *next) {
 	    setstartpara(info, cur);
 	checkparastyle(info, cur->r, next->r.left);
 	leading = (next->r.top - cur->r.top) - cur->r.height;
-	have_end_spacing = ((leading > (cur->r.height/2) && (cur->r.height/2) > page_lineleading)  || leading > (page_lineleading + 2)) ? 1 : 0;
+	have_end_spacing = ((leading > (cur->r.height/2) && (cur->r.height/2) > info->doc->page_lineleading)  || leading > (info->doc->page_lineleading + 2)) ? 1 : 0;
 	if (have_end_spacing || atparaend(info, cur, next) ||
 	    atpageend(info, cur, next)) {
 	    checkcenter(info, cur);
 	    printparatexts(info, cur, next, have_end_spacing);
-	    page_prevstyle = info->style;
+	    info->doc->page_prevstyle = info->style;
 	    info->paranum++;
 	    info->startpara = 0;
 	    info->startindex = -1;
@@ -1335,11 +1367,12 @@ struct Rect page_setminbounds(struct Rect a, struct Rect min) {
   * page_processpara
   *  prints out line numbers associated with each paragraph in a page
   */
-void page_processpara(struct Page *page, struct Rect minbounds, struct array *texts, struct hashtable *pagestarts, int dontprint) {
+void page_processpara(struct Page *page, struct Rect minbounds, struct array *texts, struct array *lines, struct hashtable *pagestarts, int dontprint) {
     struct para_info info = {0};
     int i, length;
     
     removeempties(page);
+    info.doc = page->doc;
     info.lineno = 1;
     info.paranum = 1;
     info.bounds = page_setminbounds(page_textbounds(page), minbounds);
@@ -1347,12 +1380,13 @@ void page_processpara(struct Page *page, struct Rect minbounds, struct array *te
     info.dontprint = dontprint;
     info.printerr = 1;
     info.notestyle = 1;
-    info.shortlines = calcshortlines(info.bounds.width);
-    if (!dontprint && page_showpara)
-	fprintf(stderr, "page %d:\n", page->number);
-    linetable_enum_linetable(page->texts, &info, 0, findpara);
-    if (!texts || !pagestarts)
+    info.shortlines = calcshortlines(info.doc, info.bounds.width);
+    if (!dontprint && info.doc->page_showpara)
+	sink_printf(info.doc->diag, "page %d:\n", page->number);
+    linetable_enum(page_lines(page), page_length(page), &info, findpara);
+    if (!texts || !lines || !pagestarts)
 	return;
+    linetable_append(lines, page_lines(page), array_length(texts));
     length = array_length(page->texts);
     for (i = 0; i < length; i++) {
 	struct Text *text = array_elementat(page->texts, i);
@@ -1366,48 +1400,56 @@ void page_processpara(struct Page *page, struct Rect minbounds, struct array *te
   * page_printpara
   *  prints out line numbers associated with each paragraph in a page
   */
-void page_printpara(struct Page *page, struct Rect minbounds, struct array *texts, struct hashtable *pagestarts) {
-    page_processpara(page, minbounds, texts, pagestarts, 0);
+void page_printpara(struct Page *page, struct Rect minbounds, struct array *texts, struct array *lines, struct hashtable *pagestarts) {
+    page_processpara(page, minbounds, texts, lines, pagestarts, 0);
 }
 
  /*
   * page_initpara
-  *  inits some stuff in a page object -- is this necessary now ???
+  *  segments a page without printing, called on every page before the per-page
+  *  pass. it sets page_indentleft, page_outdentleft and page_prevstyle as they
+  *  are when that pass starts
   */
 void page_initpara(struct Page *page, struct Rect minbounds) {
-    page_processpara(page, minbounds, NULL, NULL, 1);
+    page_processpara(page, minbounds, NULL, NULL, NULL, 1);
 }
 
  /*
   * page_multipleparas
-  *  enumerates all text objects and generates html, styles, and some debugging info
+  *  enumerates all text objects and generates html, styles, and some debugging info.
+  *  paragraphs are found once, the styles are printed, then the recorded paragraphs
   */
-void page_multipleparas(FILE *file, struct array *texts, struct hashtable *pagestarts, struct Rect minbounds) {
+void page_multipleparas(struct Doc *doc, struct Sink *sink, struct array *texts, struct array *lines, struct hashtable *pagestarts, struct Rect minbounds) {
     struct para_info info = {0};
-    struct para_info zero = {0};
+    int i, length;
     
+    if (doc->page_showpara)
+	sink_printf(doc->diag, "\n\nconsolidated pages:\n");
+    info.doc = doc;
     info.lineno = 1;
     info.paranum = 1;
     info.minbounds = minbounds;
     info.pagestarts = pagestarts;
     info.texts = texts;
     info.notestyle = 1;
-    linetable_enum_linetable(texts, &info, 1, findpara);
-
-    html_printstyles(file);
-    if (page_showpara)
-	fprintf(stderr, "\n\nconsolidated pages:\n");
-    info = zero;
-    info.lineno = 1;
-    info.paranum = 1;
-    info.minbounds = minbounds;
-    info.pagestarts = pagestarts;
-    info.texts = texts;
-    info.printstyle = 1;
     info.printerr = 1;
-    info.file = file;
-    linetable_enum_linetable(texts, &info, 1, findpara);
-    html_printtail(file);
+    info.paras = array_init(sizeof(struct Para), 0);
+    stats_begin(doc->stats, STATS_CONSOLIDATE);
+    linetable_enum(lines, array_length(texts), &info, findpara);
+    sink_flush(doc->diag);
+
+    stats_begin(doc->stats, STATS_EMIT);
+    html_printstyles(doc, sink);
+    length = array_length(info.paras);
+    if (doc->stats)
+	doc->stats->paras = length;
+    for (i = 0; i < length; i++) {
+	struct Para *para = array_elementat(info.paras, i);
+	html_printtexts(doc, sink, texts, para->startline, para->endindex, para->style,
+	    para->r, para->other, para->bounds.left, para->bounds.width);
+    }
+    html_printtail(sink);
+    array_free(info.paras);
 }
 
  /*
@@ -1416,12 +1458,12 @@ void page_multipleparas(FILE *file, struct array *texts, struct hashtable *pages
   */
 void page_printchapter(struct Page *page, int fontsize) {
     int i, length = array_length(page->texts);
-    if (page->number >= page_first) {
+    if (page->number >= page->doc->page_first) {
 	for (i = 0; i < length; i++) {
 	    struct Text *text = array_elementat(page->texts, i);
 	    int size = text_fontsize(text);
 	    if (size >= fontsize) {
-		fprintf(stderr, "New chapter on page %d.\n", page->number);
+		sink_printf(page->doc->diag, "New chapter on page %d.\n", page->number);
 		break;
 	    }
 	}
@@ -1435,30 +1477,26 @@ void page_printchapter(struct Page *page, int fontsize) {
 void page_print(struct Page *page) {
     int i, length;
     page_sort(page);
-    fprintf(stderr, "<page number=\"%d\" position=\"absolute\" top=\"0\" left=\"0\" height=\"%d\" width=\"%d\">\n", page->number, page->height, page->width);
+    sink_printf(page->doc->diag, "<page number=\"%d\" position=\"absolute\" top=\"0\" left=\"0\" height=\"%d\" width=\"%d\">\n", page->number, page->height, page->width);
     length = array_length(page->texts);
     for (i = 0; i < length; i++) {
 	struct Text *text = array_elementat(page->texts, i);
-	text_print(text);
+	text_print(text, page->doc->diag);
     }
-    fprintf(stderr, "</page>\n");
+    sink_puts(page->doc->diag, "</page>\n");
 }
 
 
 struct PrintInfo {
     int lineno;
-    FILE *file;
+    struct Sink *sink;
     struct array *texts;
-    int length;
 };
 
 static int printline(void *context, struct Line *cur, struct Line *next) {
     struct PrintInfo *printinfo = (struct PrintInfo *) context;
-    int last;
-    fprintf(printinfo->file, "%2d ", printinfo->lineno);
-    last = (next->index) ? next->index : printinfo->length;
-    
-    text_printcontents(printinfo->texts, printinfo->file, cur->index, last);
+    sink_printf(printinfo->sink, "%2d ", printinfo->lineno);
+    text_printcontents(printinfo->texts, printinfo->sink, cur->index, cur->last + 1);
     printinfo->lineno++;
     return 1;
 }
@@ -1467,13 +1505,11 @@ static int printline(void *context, struct Line *cur, struct Line *next) {
   * page_printcontents
   *  print the text lines of a page
   */
-void page_printcontents(struct Page *page, FILE *file) {
+void page_printcontents(struct Page *page, struct Sink *sink) {
     struct PrintInfo printinfo;
-    page_sort(page);
     printinfo.lineno = 1;
-    printinfo.file = file;
+    printinfo.sink = sink;
     printinfo.texts = page->texts;
-    printinfo.length = array_length(page->texts);
-    linetable_enum_linetable(page->texts, &printinfo, 0, printline);
+    linetable_enum(page_lines(page), page_length(page), &printinfo, printline);
 }
 
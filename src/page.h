@@ -26,15 +26,30 @@ struct Page;
 struct Text;
 struct hashtable;
 struct array;
+struct histogram;
+struct Doc;
+struct Sink;
 #include "rect.h"
 #include <stdio.h>
 
+ /*
+  * Layout
+  *  frequency tables of the line geometry of a document, filled by page_getlayout
+  */
+struct Layout {
+    int bias;				/* added to leadings so small negatives are kept */
+    struct histogram *left;		/* left position of lines */
+    struct histogram *right;		/* right position of lines */
+    struct histogram *fontsize;		/* font, by font_printindex, of first text in lines */
+    struct histogram *lineheight;	/* height of first text in lines */
+    struct histogram *leading;		/* leading between lines, plus bias */
+};
 
  /*
   * page_init
-  *  create a page object
+  *  create a page object of doc
   */
-struct Page *page_init(int number, int width, int height);
+struct Page *page_init(struct Doc *doc, int number, int width, int height);
 
  /*
   * page_free
@@ -75,11 +90,12 @@ void page_printchapter(struct Page *page, int fontsize);
   * page_printpara
   *  print to stderr paragraph grouping
   */
-void page_printpara(struct Page *page, struct Rect minbounds, struct array *texts, struct hashtable *pagestarts);
+void page_printpara(struct Page *page, struct Rect minbounds, struct array *texts, struct array *lines, struct hashtable *pagestarts);
 
  /*
   * page_initpara
-  *  inits some stuff in a page object -- is this necessary now ???
+  *  segments a page without printing, to set the indent and outdent positions
+  *  and the previous style before the per-page pass
   */
 void page_initpara(struct Page *page, struct Rect minbounds);
 
@@ -87,7 +103,7 @@ void page_initpara(struct Page *page, struct Rect minbounds);
   * page_multipleparas
   *  enumerates all text objects and generates html, styles, and some debugging info
   */
-void page_multipleparas(FILE *file, struct array *texts, struct hashtable *pagestarts, struct Rect minbounds);
+void page_multipleparas(struct Doc *doc, struct Sink *sink, struct array *texts, struct array *lines, struct hashtable *pagestarts, struct Rect minbounds);
 
  /*
   * page_print
@@ -102,64 +118,41 @@ void page_print(struct Page *page);
 struct Rect page_textbounds(struct Page *page);
 
  /*
-  * page_getleadings
-  *  place leading values into the hashtable. key=leading, val=count
-  */
-void page_getleadings(struct Page *page, struct hashtable *hash, int bias);
-
- /*
-  * page_getleft
-  *  place left positions of text objects into the hashtable. key=left, val=count
+  * page_getlayout
+  *  place left, right, font size, line height and leading values of the lines
+  *  of the page into the histograms of layout
   */
-void page_getleft(struct Page *page, struct hashtable *hash);
-
- /*
-  * page_getright
-  *  place right positions of text objects into the hashtable. key=right, val=count
-  */
-void page_getright(struct Page *page, struct hashtable *hash);
-
- /*
-  * page_getfontsize
-  *  place font sizes of text objects into the hashtable. key=fontsize, val=count
-  */
-void page_getfontsize(struct Page *page, struct hashtable *hash);
+void page_getlayout(struct Page *page, struct Layout *layout);
 
  /*
   * page_setlineleading
   *  sets the most common line leading in document
   */
-void page_setlineleading(int leading);
-
- /*
-  * page_getlineheight
-  *  place line height of text objects into the hashtable. key=height, val=count
-  */
-void page_getlineheight(struct Page *page, struct hashtable *hash);
+void page_setlineleading(struct Doc *doc, int leading);
 
  /*
   * page_setlineheight
   *  sets the most common lineheight in document
   */
-void page_setlineheight(int lineheight);
+void page_setlineheight(struct Doc *doc, int lineheight);
 
  /*
   * page_setindent
   *  sets the x pos an indented line
   */
-void page_setindent(int indent);
+void page_setindent(struct Doc *doc, int indent);
 
  /*
   * page_cropbottom
   *  crop text objects whose top is greater than "maxtop"
   */
-void page_cropbottom(int maxtop);
+void page_cropbottom(struct Doc *doc, int maxtop);
 
  /*
   * page_croptop
   *  crop text objects whose top is less than "mintop"
   */
-void page_croptop(int mintop);
+void page_croptop(struct Doc *doc, int mintop);
 
  /*
   * page_sort
@@ -171,29 +164,26 @@ void page_sort(struct Page *page);
   * page_setrag
   *  set no-justify, or rag-right
   */
-void page_setrag();
-
- /*
-  * put_int
-  *  if leading exists in hashtable, increment value. 
-  *  if force, then alway increment
-  *  returns 1 if successful, 0 if nothing happened
-  */
-int put_int(struct hashtable *hash, int leading, int force);
+void page_setrag(struct Doc *doc);
 
  /*
   * setPageRange
   *  parse page ranges for --dontreflow option, ie "1-3,4,10, 99-102"
   *  very strict about input, no accomodation for whitespace
   */
-void setPageRange(char *range);
+void setPageRange(struct Doc *doc, char *range);
 
+ /*
+  * page_freeranges
+  *  frees the page ranges of the --dontreflow option
+  */
+void page_freeranges(struct Doc *doc);
 
  /*
   * page_setshowpara
   *  debugging option --showpara
   */
-void page_setshowpara();
+void page_setshowpara(struct Doc *doc);
 
  /*
   * page_setcenter
@@ -205,18 +195,18 @@ void page_setcenter(struct Page *page, int lineno);
   * page_printcontents
   *  print the text lines of a page
   */
-void page_printcontents(struct Page *page, FILE *file);
+void page_printcontents(struct Page *page, struct Sink *sink);
 
  /*
   * page_setnonfiction
   *  text does not have a lot of dialog, not dependent on indent
   */
-void page_setnonfiction();
+void page_setnonfiction(struct Doc *doc);
 
  /*
   * page_setshortlines
   *  break paragraphs on short lines
   */
-void page_setshortlines(int percent);
+void page_setshortlines(struct Doc *doc, int percent);
 
 #endif /* INCLUDED_PAGE_H */ 
@@ -27,100 +27,439 @@
 #include "parse.h"
 #include "text.h"
 #include "array.h"
-#include <ctype.h>
+#include "scan.h"
+#include "doc.h"
+#include "stats.h"
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #define PDF2XML "<pdf2xml"
 #define BUFSIZE 102400
 
-static char errbuf[1024];
-static int lineno = 0;
-static char *curtag = 0;
-static char *curval = 0;
-static char *encoding = 0;
-
-struct array *pages = 0;
-
-struct Atom *atom_encoding;
-struct Atom *atom_number;
-struct Atom *atom_position;
-struct Atom *atom_top;
-struct Atom *atom_left;
-struct Atom *atom_height;
-struct Atom *atom_width;
-struct Atom *atom_font;
-struct Atom *atom_id;
-struct Atom *atom_size;
-struct Atom *atom_family;
-struct Atom *atom_color;
+ /*
+  * struct Input
+  *  the pdf2xml input. A regular file is memory mapped read only, and the
+  *  text objects point into the mapping. Anything else (stdin from a pipe, etc.)
+  *  is read a line at a time into buf with fgets, and the contents of text tags
+  *  are copied into the string pool.
+  */
+struct Input {
+    FILE *file;		/* input stream */
+    char *buf;		/* line buffer of BUFSIZE, used by the fgets path */
+    char *lineend;	/* end of the current line (not NUL terminated for mapped input) */
+    char *map;		/* start of the mapped file, NULL if not mapped */
+    size_t maplen;	/* length of the mapping */
+    size_t bytes;	/* bytes read by the fgets path */
+    int borrowed;	/* map is a buffer of the caller, not a mapping to release */
+    char *pos;		/* start of the next line in the mapping */
+    char *end;		/* end of the mapping, or of the pages given to a worker */
+    struct array *pool;	/* chunks of the string pool */
+    char *poolcur;	/* next free char in the current chunk */
+    char *poolend;	/* end of the current chunk */
+};
+
+#define POOLSIZE 65536
+
+ /*
+  * the attributes of the pdf2xml schema, decoded into struct Tag without
+  * going through attr.h. The integer ones come first.
+  */
+enum {
+    TAG_TOP,
+    TAG_LEFT,
+    TAG_WIDTH,
+    TAG_HEIGHT,
+    TAG_SIZE,
+    TAG_NUMBER,
+    TAG_FONT,
+    TAG_ID,
+    TAG_FAMILY,
+    TAG_COLOR,
+    TAG_COUNT
+};
+
+#define TAG_INTS TAG_FONT	/* slots below are integers */
 
+static char *tagnames[TAG_COUNT] = {
+    "top", "left", "width", "height", "size", "number",
+    "font", "id", "family", "color"
+};
+
+ /*
+  * struct Tag
+  *  the known attributes of the current tag. present and valid have a bit
+  *  per slot, an integer that does not parse is reported when it is used.
+  */
+struct Tag {
+    unsigned int present;	/* slots found in the tag */
+    unsigned int valid;		/* integer slots that parsed */
+    int value[TAG_INTS];	/* parsed integers */
+    char *str[TAG_COUNT];	/* values, NUL terminated in tagbuf for strings */
+    int len[TAG_COUNT];		/* length of the values */
+};
+
+ /*
+  * struct Parser
+  *  the state of one parser. The document is parsed by one parser, unless
+  *  pages are parsed by several threads, then each thread has its own.
+  */
+struct Parser {
+    struct Doc *doc;		/* the document being parsed */
+    struct Input *in;		/* input, workers have a copy bounded to their pages */
+    int lineno;			/* current line number of the input */
+    char errbuf[1024];
+    char *curval;		/* value between tag & endtag, not NUL terminated */
+    int curlen;			/* length of curval */
+    char *tagbuf;		/* NUL terminated names & values of the current tag */
+    int tagbufsize;
+    int tagbufused;
+    struct Tag tag;		/* known attributes of the current tag */
+    struct Attrs *attrs;	/* other attributes of the current tag */
+    int hasattrs;		/* attrs is not empty */
+    char fontid[16];		/* id of the last font looked up */
+    int font;			/* its index */
+    FILE *err;			/* where errors are printed, NULL discards them */
+    char *errtext;		/* errors of a worker, buffered until the pages are joined */
+    size_t errsize;
+    int quiet;			/* discard errors, the page scan reports nothing */
+    int scanned;		/* fonts were already added by the page scan */
+    int fontschanged;		/* a text was read before its font, or a font changed size */
+};
+
+static struct Atom *atom_encoding;
+static struct Atom *atom_position;
+static pthread_once_t parse_once = PTHREAD_ONCE_INIT;
+
+ /*
+  * parse_init
+  *  called once for all documents, picks the scanners and makes the atoms
+  */
 static void parse_init() {
-    pages = array_pointer_init(0);
+    scan_init();
     atom_encoding = attr_atom("encoding");
-    atom_number = attr_atom("number");
     atom_position = attr_atom("position");
-    atom_top = attr_atom("top");
-    atom_left = attr_atom("left");
-    atom_height = attr_atom("height");
-    atom_width = attr_atom("width");
-    atom_font = attr_atom("font");
-    atom_id = attr_atom("id");
-    atom_size = attr_atom("size");
-    atom_family = attr_atom("family");
-    atom_color = attr_atom("color");
 }
 
  /*
   * parse_encoding
   *  returns the character encoding
   */
-char *parse_encoding() {
-    return encoding;
+char *parse_encoding(struct Doc *doc) {
+    return doc->encoding;
+}
+
+ /*
+  * parse_inputsize
+  *  returns the number of bytes of input read
+  */
+size_t parse_inputsize(struct Doc *doc) {
+    if (!doc->input)
+	return 0;
+    return doc->input->map ? doc->input->maplen : doc->input->bytes;
+}
+
+ /*
+  * parse_setthreads
+  *  number of threads used to parse the pages of a memory mapped input
+  */
+void parse_setthreads(struct Doc *doc, int count) {
+    doc->threads = (count > 0) ? count : 1;
 }
 
 
+ /*
+  * input_open
+  *  memory map file if it is a regular file, otherwise fall back to fgets
+  */
+static void input_open(struct Input *in, FILE *file) {
+    struct stat st;
+    memset(in, 0, sizeof(struct Input));
+    in->file = file;
+    in->buf = malloc(BUFSIZE);
+    in->pool = array_pointer_init(0);
+    if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+	return;
+    /* the stream has already been read from, stay with stdio */
+    if (ftello(file) != 0)
+	return;
+    in->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (in->map == MAP_FAILED) {
+	in->map = NULL;
+	return;
+    }
+    madvise(in->map, st.st_size, MADV_SEQUENTIAL);
+    in->maplen = st.st_size;
+    in->pos = in->map;
+    in->end = in->map + st.st_size;
+}
+
+ /*
+  * input_openbuffer
+  *  read from a buffer in memory as if it were a mapped file, the buffer
+  *  must outlive the pages
+  */
+static void input_openbuffer(struct Input *in, const char *buf, size_t length) {
+    memset(in, 0, sizeof(struct Input));
+    in->buf = malloc(BUFSIZE);
+    in->pool = array_pointer_init(0);
+    in->map = (char *)buf;
+    in->maplen = length;
+    in->borrowed = 1;
+    in->pos = in->map;
+    in->end = in->map + length;
+}
+
+ /*
+  * input_close
+  *  release the mapping, the string pool and the line buffer
+  */
+static void input_close(struct Input *in) {
+    int i, length;
+    if (in->map && !in->borrowed)
+	munmap(in->map, in->maplen);
+    if (in->pool) {
+	length = array_length(in->pool);
+	for (i = 0; i < length; i++)
+	    free(array_elementat(in->pool, i));
+	array_free(in->pool);
+    }
+    free(in->buf);
+    memset(in, 0, sizeof(struct Input));
+}
+
+ /*
+  * input_keep
+  *  returns a copy of str that lives as long as the input. Strings in the
+  *  mapping are returned as is, others are copied into the string pool
+  *  and NUL terminated.
+  */
+static char *input_keep(struct Input *in, char *str, int length) {
+    char *result;
+    if (in->map && str >= in->map && str < (in->map + in->maplen))
+	return str;
+    if ((length + 1) > (in->poolend - in->poolcur)) {
+	int size = (length + 1) > POOLSIZE ? (length + 1) : POOLSIZE;
+	in->poolcur = malloc(size);
+	in->poolend = in->poolcur + size;
+	array_append_element(in->pool, in->poolcur);
+    }
+    result = in->poolcur;
+    memcpy(result, str, length);
+    result[length] = 0;
+    in->poolcur += length + 1;
+    return result;
+}
+
+ /*
+  * parser_init
+  *  init the state of a parser reading from in, errors go to err
+  */
+static void parser_init(struct Parser *p, struct Doc *doc, struct Input *in, FILE *err) {
+    memset(p, 0, sizeof(struct Parser));
+    p->doc = doc;
+    p->in = in;
+    p->err = err;
+    p->attrs = attr_create();
+}
+
+ /*
+  * parser_free
+  *  frees the buffers of a parser
+  */
+static void parser_free(struct Parser *p) {
+    attr_free(p->attrs);
+    free(p->tagbuf);
+    memset(p, 0, sizeof(struct Parser));
+}
+
  /*
   * mygets
-  *  version of fgets that maintains the current line number of the input
+  *  version of fgets that maintains the current line number of the input.
+  *  in->lineend is set to the end of the returned line. Mapped lines are 
+  *  returned in place, and are not NUL terminated.
   */
 static char *
-mygets(char *s, int n, FILE *stream) {
-    char *res = fgets(s, n, stream);
-    lineno++;
-    return res;
+mygets(struct Parser *p) {
+    struct Input *in = p->in;
+    char *line, *nl;
+    p->lineno++;
+    if (!in->map) {
+	line = fgets(in->buf, BUFSIZE, in->file);
+	if (line) {
+	    in->lineend = line + strlen(line);
+	    in->bytes += in->lineend - line;
+	}
+	return line;
+    }
+    if (in->pos >= in->end)
+	return NULL;
+    line = in->pos;
+    nl = memchr(line, '\n', in->end - line);
+    if (nl) {
+	in->lineend = nl;
+	in->pos = nl + 1;
+    } else {
+	in->lineend = in->end;
+	in->pos = in->end;
+    }
+    return line;
+}
+
+ /*
+  * startswith
+  *  returns 1 if the line at cur starts with str
+  */
+static int startswith(char *cur, char *end, char *str, int length) {
+    return ((end - cur) >= length && !memcmp(cur, str, length));
 }
 
  /*
   * skipwhite
-  *  skip over white spaces using isspace.
+  *  skip over white spaces. Most tags follow a single space, or none, so
+  *  check the first char before the vector scan.
   */
-static char *skipwhite(char *buf) {
-    char *cur;
-    for (cur = buf; *cur; cur++) {
-	if (!isspace(*cur))
-	    return cur;
-    }
-    return cur;
+static char *skipwhite(char *buf, char *end) {
+    if (buf < end && !scan_isspace(*buf))
+	return buf;
+    return scan_skipwhite(buf, end);
 }
 
  /*
   * skiptoken
   *  skip over non spaces && non endchar.
   */
-static char *skiptoken(char *buf, char endchar) {
-    char *cur;
-    for (cur = buf; *cur; cur++) {
-	if (isspace(*cur) || *cur == endchar)
+static char *skiptoken(char *buf, char *end, char endchar) {
+    return scan_skiptoken(buf, end, endchar);
+}
+
+ /*
+  * findstr
+  *  returns the first str between cur and end, or NULL
+  */
+static char *findstr(char *cur, char *end, char *str, int length) {
+    while ((cur = memchr(cur, str[0], end - cur))) {
+	if (startswith(cur, end, str, length))
 	    return cur;
+	cur++;
     }
-    return cur;
+    return NULL;
+}
+
+ /*
+  * tagstr
+  *  copy a name or value of the current tag into tagbuf, so that it can be NUL
+  *  terminated without writing into the input
+  */
+static char *tagstr(struct Parser *p, char *str, int length) {
+    char *result = p->tagbuf + p->tagbufused;
+    memcpy(result, str, length);
+    result[length] = 0;
+    p->tagbufused += length + 1;
+    return result;
+}
+
+ /*
+  * parse_error
+  *  print an error. Workers create their error buffer on the first error.
+  */
+static void parse_error(struct Parser *p, char *format, ...) {
+    va_list args;
+    if (p->quiet)
+	return;
+    if (!p->err) {
+	p->err = open_memstream(&p->errtext, &p->errsize);
+	if (!p->err)
+	    p->err = stderr;
+    }
+    va_start(args, format);
+    vfprintf(p->err, format, args);
+    va_end(args);
+}
+
+static void parse_errout(struct Parser *p, char *str) {
+    parse_error(p, "%s at line %d.\n", str, p->lineno);
+}
+
+
+ /*
+  * tagslot
+  *  returns the slot of a known attribute name, or -1
+  */
+static int tagslot(char *name, int length) {
+    int slot = -1;
+    switch (length) {
+	case 2: slot = TAG_ID; break;
+	case 3: slot = TAG_TOP; break;
+	case 4: slot = (name[0] == 'l') ? TAG_LEFT : (name[0] == 'f') ? TAG_FONT : TAG_SIZE; break;
+	case 5: slot = (name[0] == 'w') ? TAG_WIDTH : TAG_COLOR; break;
+	case 6: slot = (name[0] == 'h') ? TAG_HEIGHT : (name[0] == 'f') ? TAG_FAMILY : TAG_NUMBER; break;
+	default: return -1;
+    }
+    return memcmp(name, tagnames[slot], length) ? -1 : slot;
 }
 
-static void parse_errout(char *str) {
-    fprintf(stderr, "%s at line %d.\n", str, lineno);
+ /*
+  * tagint
+  *  parses a plain decimal integer, returns 0 if the value needs strtol
+  */
+static int tagint(char *str, int length, int *value) {
+    int i = 0, val = 0;
+    if (length && str[0] == '-')
+	i = 1;
+    if (i == length || (length - i) > 9)
+	return 0;
+    for (; i < length; i++) {
+	if (str[i] < '0' || str[i] > '9')
+	    return 0;
+	val = (val * 10) + (str[i] - '0');
+    }
+    *value = (str[0] == '-') ? -val : val;
+    return 1;
 }
 
+ /*
+  * putattr
+  *  store an attribute of the current tag. Known attributes go into their
+  *  slot, integers are parsed here, others go to attr.h
+  */
+static void putattr(struct Parser *p, char *name, int namelen, char *value, int length) {
+    struct Tag *tag = &p->tag;
+    int slot = tagslot(name, namelen);
+    unsigned int bit;
+    if (slot < 0) {
+	name = tagstr(p, name, namelen);
+	attr_put(p->attrs, name, tagstr(p, value, length));
+	p->hasattrs = 1;
+	return;
+    }
+    bit = 1 << slot;
+    tag->present |= bit;
+    tag->len[slot] = length;
+    if (slot >= TAG_INTS) {
+	tag->str[slot] = tagstr(p, value, length);
+	return;
+    }
+    tag->str[slot] = value;
+    if (tagint(value, length, &tag->value[slot])) {
+	tag->valid |= bit;
+    } else {
+	char *end = 0;
+	value = tagstr(p, value, length);
+	tag->str[slot] = value;
+	tag->len[slot] = strlen(value);
+	tag->value[slot] = strtol(value, &end, 10);
+	if (end != value && !*end)
+	    tag->valid |= bit;
+	else
+	    tag->valid &= ~bit;
+    }
+}
 
  /*
   * parseattr
@@ -128,74 +467,78 @@ static void parse_errout(char *str) {
   *  *err is set to 1 if a parse error occured
   *  returns the current position in buffer
   */
-static char *parseattr(char *cur, int *err) {
+static char *parseattr(struct Parser *p, char *cur, char *end, int *err) {
     char *name = NULL;
     char *value = NULL;
-    cur = skipwhite(cur);
+    int namelen;
+    cur = skipwhite(cur, end);
     name = cur;
-    cur = skiptoken(cur, '=');
-    if (isspace(*cur)) {
-	*cur = 0;
-	cur = skipwhite(cur + 1);
-    }
-    if (*cur != '=') {
-	parse_errout("Missing '=' at");
+    cur = skiptoken(cur, end, '=');
+    namelen = cur - name;
+    if (cur < end && scan_isspace(*cur))
+	cur = skipwhite(cur + 1, end);
+    if (cur == end || *cur != '=') {
+	parse_errout(p, "Missing '=' at");
 	goto nope;
     }
-    *cur = 0;
-    cur = skipwhite(cur + 1);
-    if (*cur != '"') {
-	parse_errout("Missing start quote");
+    cur = skipwhite(cur + 1, end);
+    if (cur == end || *cur != '"') {
+	parse_errout(p, "Missing start quote");
 	goto nope;
     }
     cur++;
     value = cur;
-    cur = strchr(cur, '"');
-    if (*cur != '"') {
-	parse_errout("Missing end quote");
+    cur = memchr(cur, '"', end - cur);
+    if (!cur) {
+	parse_errout(p, "Missing end quote");
 	goto nope;
     }
-    *cur = 0;
-    attr_put(name, value);
+    putattr(p, name, namelen, value, cur - value);
     cur = cur + 1;
     return cur;
 nope:
     *err = 1;
-    return cur + strlen(cur);
+    return end;
 }
 
  /*
   * parsetag
   *  parses xml tag. endtag is the ending tag, ie </page>
   *  return 1 on success, 0 on error
-  *  key value attributes are store in attr.h
-  *  curtag is tagname, curval is value between tag & endtag
+  *  key value attributes are stored in p->tag, or p->attrs if not known
+  *  p->curval is value between tag & endtag, p->curlen its length
   */
-static int parsetag(char *cur, char *endtag) {
+static int parsetag(struct Parser *p, char *cur, char *end, char *endtag) {
     int err = 0;
-    attr_reset();
-    curtag = cur + 1;
-    curval = NULL;
-    cur = skiptoken(cur, '>');
-    if (*cur == '>') {
-	*cur = 0;
-	return 1;
+    char *val;
+    p->tag.present = 0;
+    p->tag.valid = 0;
+    if (p->hasattrs) {
+	attr_reset(p->attrs);
+	p->hasattrs = 0;
     }
-    if (isspace(*cur)) {
-	*cur++ = 0;
+    if ((end - cur) >= p->tagbufsize) {
+	p->tagbufsize = (end - cur) + BUFSIZE;
+	p->tagbuf = realloc(p->tagbuf, p->tagbufsize);
     }
-    while (!err && *cur && (*cur != '>') && (*cur != '/') && (*cur != '?')) {
-	cur = parseattr(cur, &err);
+    p->tagbufused = 0;
+    p->curval = NULL;
+    p->curlen = 0;
+    cur = skiptoken(cur, end, '>');
+    if (cur < end && *cur == '>')
+	return 1;
+    if (cur < end && scan_isspace(*cur))
+	cur++;
+    while (!err && cur < end && *cur && (*cur != '>') && (*cur != '/') && (*cur != '?')) {
+	cur = parseattr(p, cur, end, &err);
     }
     if (err)
 	return 0;
-    if (*cur == '>' && endtag) {
+    if (cur < end && *cur == '>' && endtag) {
 	cur++;
-	curval = cur;
-	cur = strstr(cur, endtag);
-	if (cur) {
-	    *cur = 0;
-	}
+	val = findstr(cur, end, endtag, strlen(endtag));
+	p->curval = cur;
+	p->curlen = (val ? val : end) - cur;
     }
     return 1;
 }
@@ -204,11 +547,13 @@ static int parsetag(char *cur, char *endtag) {
   * parse_pdf2xml
   *  parses a pdf2xml text file
   */
-static void parsexmltag(char *buf) {
-    if (parsetag(buf, NULL)) {
-	char *val = attr_get(atom_encoding);
-	if (val)
-	    encoding = strdup(val);
+static void parsexmltag(struct Parser *p, char *buf, char *end) {
+    if (parsetag(p, buf, end, NULL)) {
+	char *val = attr_get(p->attrs, atom_encoding);
+	if (val) {
+	    free(p->doc->encoding);
+	    p->doc->encoding = strdup(val);
+	}
     }
 
 }
@@ -217,45 +562,84 @@ static void parsexmltag(char *buf) {
   * getint
   *  returns -1 on error
   */
-static int getint(struct Atom *atom) {
-    char *valstr = attr_get(atom);
-    char *end = 0;
-    int val;
-    if (!valstr)
+static int getint(struct Parser *p, int slot) {
+    struct Tag *tag = &p->tag;
+    unsigned int bit = 1 << slot;
+    if (!(tag->present & bit))
 	return -1;
-    val = strtol(valstr, &end, 10);
-    if (end != valstr && !*end) {
-	return val;
-    }
-    fprintf(stderr, "Attribute %s has an invalid value %s on line %d.\n", 
-	(char *)atom, valstr, lineno);
+    if (tag->valid & bit)
+	return tag->value[slot];
+    parse_error(p, "Attribute %s has an invalid value %.*s on line %d.\n", 
+	tagnames[slot], tag->len[slot], tag->str[slot], p->lineno);
     return -1;
 }
 
+ /*
+  * getstr
+  *  returns the value of a string attribute, or NULL
+  */
+static char *getstr(struct Parser *p, int slot) {
+    return (p->tag.present & (1 << slot)) ? p->tag.str[slot] : NULL;
+}
+
+ /*
+  * fontdefined
+  *  returns 1 if the font has been defined before the current line. After a
+  *  page scan all fonts are defined, so the line of the definition decides.
+  */
+static int fontdefined(struct Parser *p, int font) {
+    if (p->scanned) {
+	int line = (font < p->doc->fontlinecount) ? p->doc->fontlines[font] : 0;
+	return line && line < p->lineno;
+    }
+    return font_family(p->doc, font) != NULL;
+}
+
+ /*
+  * getfont
+  *  returns the font index of id. Texts mostly use the font of the text
+  *  before them, so the last id is remembered.
+  */
+static int getfont(struct Parser *p, char *id) {
+    if (!strcmp(id, p->fontid))
+	return p->font;
+    p->font = font_index(p->doc, id);
+    if (strlen(id) < sizeof(p->fontid))
+	strcpy(p->fontid, id);
+    else
+	p->fontid[0] = 0;
+    return p->font;
+}
+
  /*
   * parse_text
   *  parses a text entry
   *  return 1 on success, NULL on error
   */
-static struct Text *parse_text(FILE *file, char *buf, char *cur) {
+static struct Text *parse_text(struct Parser *p, char *cur) {
     struct Text *text = NULL;
-    if (parsetag(cur, "</text>")) {
-	int top = getint(atom_top);
-	int left = getint(atom_left);
-	int height = getint(atom_height);
-	int width = getint(atom_width);
-	char *fontid = attr_get(atom_font);
-	struct Atom *font = NULL;
+    if (parsetag(p, cur, p->in->lineend, "</text>")) {
+	int top = getint(p, TAG_TOP);
+	int left = getint(p, TAG_LEFT);
+	int height = getint(p, TAG_HEIGHT);
+	int width = getint(p, TAG_WIDTH);
+	char *fontid = getstr(p, TAG_FONT);
+	int font = -1;
+	int fontsize = -1;
 	if (!fontid) {
-	    parse_errout("Missing font id value");
+	    parse_errout(p, "Missing font id value");
 	} else {
-	    font = attr_atom(fontid);
-	    if (!font_family(font)) {
-		sprintf(errbuf, "Invalid font id %s", fontid);
-		parse_errout(errbuf);
+	    font = getfont(p, fontid);
+	    if (!fontdefined(p, font)) {
+		sprintf(p->errbuf, "Invalid font id %s", fontid);
+		parse_errout(p, p->errbuf);
+		p->fontschanged = 1;
+	    } else {
+		fontsize = font_size(p->doc, font);
 	    }
 	}
-	text = text_init(top, left, width, height, font, curval);
+	text = text_init(top, left, width, height, font, fontsize,
+	    p->curval ? input_keep(p->in, p->curval, p->curlen) : NULL, p->curlen);
     }
     return text;
 }
@@ -265,13 +649,14 @@ static struct Text *parse_text(FILE *file, char *buf, char *cur) {
   *  parses a page entry
   *  return 1 on success, 0 on error
   */
-static int parse_font(FILE *file, char *buf, char *cur) {
-    if (parsetag(cur, NULL)) {
-	int size = getint(atom_size);
-	char *id = attr_get(atom_id);
-	char *family = attr_get(atom_family);
-	char *color = attr_get(atom_color);
-	font_add(id, size, family, color);
+static int parse_font(struct Parser *p, char *cur) {
+    if (parsetag(p, cur, p->in->lineend, NULL)) {
+	int size = getint(p, TAG_SIZE);
+	char *id = getstr(p, TAG_ID);
+	char *family = getstr(p, TAG_FAMILY);
+	char *color = getstr(p, TAG_COLOR);
+	if (!p->scanned && font_add(p->doc, id, size, family, color))
+	    p->fontschanged = 1;
 	return 1;
     }
     return 0;
@@ -284,28 +669,28 @@ static int parse_font(FILE *file, char *buf, char *cur) {
   *  parses a page entry
   *  return 1 on success, 0 on error
   */
-static struct Page *parse_page(FILE *file, char *buf, char *cur) {
-    static int pageend = 0;
+static struct Page *parse_page(struct Parser *p, char *cur) {
+    int pageend = strlen(PAGE_END);
+    struct Input *in = p->in;
     struct Page *page = NULL;
-    if (!pageend)
-	pageend = strlen(PAGE_END);
-    if (parsetag(cur, NULL)) {
-	int number = getint(atom_number);
-	int width = getint(atom_width);
-	int height = getint(atom_height);
-	struct Page *page = page_init(number, width, height);
-	while (mygets(buf, BUFSIZE, file)) {
-	    cur = skipwhite(buf);
-	    if (!strncmp(cur, "<text", 5)) {
-		struct Text *text = parse_text(file, buf, cur);
+    char *buf;
+    if (parsetag(p, cur, in->lineend, NULL)) {
+	int number = getint(p, TAG_NUMBER);
+	int width = getint(p, TAG_WIDTH);
+	int height = getint(p, TAG_HEIGHT);
+	struct Page *page = page_init(p->doc, number, width, height);
+	while ((buf = mygets(p))) {
+	    cur = skipwhite(buf, in->lineend);
+	    if (startswith(cur, in->lineend, "<text", 5)) {
+		struct Text *text = parse_text(p, cur);
 		if (text)
 		    page_addtext(page, text);
 
-	    } else if (!strncmp(cur, "<fontspec", 9)) {
-		if (!parse_font(file, buf, cur)) {
+	    } else if (startswith(cur, in->lineend, "<fontspec", 9)) {
+		if (!parse_font(p, cur)) {
 
 		}
-	    } else if (!strncmp(cur, PAGE_END, pageend)) {
+	    } else if (startswith(cur, in->lineend, PAGE_END, pageend)) {
 		return page;
 	    }
 	}
@@ -327,25 +712,209 @@ struct array_procs procs = {
 
 #define PAGE "<page"
 #define PDF2XML_END "</pdf2xml>"
+
+ /*
+  * struct PageJob
+  *  a page found by the page scan, parsed by one of the workers
+  */
+struct PageJob {
+    char *start;	/* the <page line */
+    char *end;		/* after the </page> line */
+    int lineno;		/* line number before start */
+    struct Page *page;	/* the parsed page, NULL on error */
+    char *errtext;	/* errors while parsing the page */
+    size_t errsize;
+};
+
+ /*
+  * struct Workers
+  *  the pages shared by the worker threads, next is the next page to parse
+  */
+struct Workers {
+    struct Doc *doc;
+    struct array *jobs;
+    int next;
+    int fontschanged;
+    pthread_t caller;		/* the thread of parsepages, timed by its caller */
+    double cpu;			/* cpu seconds of the other workers, for --stats */
+    pthread_mutex_t lock;
+};
+
+ /*
+  * setfontline
+  *  remember the line where a font is first defined
+  */
+static void setfontline(struct Doc *doc, int font, int line) {
+    if (font >= doc->fontlinecount) {
+	int count = doc->fontlinecount ? doc->fontlinecount : 64;
+	while (count <= font)
+	    count *= 2;
+	doc->fontlines = realloc(doc->fontlines, count * sizeof(int));
+	memset(doc->fontlines + doc->fontlinecount, 0, (count - doc->fontlinecount) * sizeof(int));
+	doc->fontlinecount = count;
+    }
+    if (!doc->fontlines[font])
+	doc->fontlines[font] = line;
+}
+
+ /*
+  * scanpages
+  *  finds the lines of each page, the same way parsepdf2xml would read them.
+  *  The fontspecs are added here, in document order, so that the workers only
+  *  read the fonts. Nothing is reported, errors are left to the workers.
+  */
+static struct array *scanpages(struct Parser *p) {
+    struct Input *in = p->in;
+    int pagelen = strlen(PAGE), pageend = strlen(PAGE_END), endlen = strlen(PDF2XML_END);
+    struct array *jobs = array_init(sizeof(struct PageJob), 0);
+    struct PageJob job;
+    char *buf, *cur;
+    p->quiet = 1;
+    while ((buf = mygets(p))) {
+	cur = skipwhite(buf, in->lineend);
+	if (startswith(cur, in->lineend, PAGE, pagelen)) {
+	    memset(&job, 0, sizeof(struct PageJob));
+	    job.start = buf;
+	    job.lineno = p->lineno - 1;
+	    if (parsetag(p, cur, in->lineend, NULL)) {
+		while ((buf = mygets(p))) {
+		    cur = skipwhite(buf, in->lineend);
+		    if (startswith(cur, in->lineend, "<fontspec", 9)) {
+			char *id;
+			if (parse_font(p, cur) && (id = getstr(p, TAG_ID)))
+			    setfontline(p->doc, font_index(p->doc, id), p->lineno);
+		    } else if (startswith(cur, in->lineend, PAGE_END, pageend)) {
+			break;
+		    }
+		}
+	    }
+	    job.end = in->pos;
+	    array_append_element(jobs, &job);
+	} else if (startswith(cur, in->lineend, PDF2XML_END, endlen)) {
+	    break;
+	}
+    }
+    p->quiet = 0;
+    return jobs;
+}
+
+ /*
+  * parseworker
+  *  thread proc, parses pages until there are none left. Each worker reads
+  *  a copy of the input bounded to the page, and buffers its errors.
+  */
+static void *parseworker(void *context) {
+    struct Workers *workers = context;
+    struct Input in = *workers->doc->input;
+    struct Parser parser;
+    struct Parser *p = &parser;
+    int length = array_length(workers->jobs);
+    int index;
+    parser_init(p, workers->doc, &in, NULL);
+    p->scanned = 1;
+    for (;;) {
+	struct PageJob *job;
+	char *buf;
+	pthread_mutex_lock(&workers->lock);
+	index = workers->next++;
+	pthread_mutex_unlock(&workers->lock);
+	if (index >= length)
+	    break;
+	job = array_elementat(workers->jobs, index);
+	in.pos = job->start;
+	in.end = job->end;
+	p->lineno = job->lineno;
+	p->err = NULL;
+	p->errtext = NULL;
+	p->errsize = 0;
+	buf = mygets(p);
+	job->page = parse_page(p, skipwhite(buf, in.lineend));
+	if (p->err && p->err != stderr) {
+	    fclose(p->err);
+	    job->errtext = p->errtext;
+	    job->errsize = p->errsize;
+	}
+    }
+    pthread_mutex_lock(&workers->lock);
+    workers->fontschanged |= p->fontschanged;
+    if (workers->doc->stats && !pthread_equal(pthread_self(), workers->caller))
+	workers->cpu += stats_threadcpu();
+    pthread_mutex_unlock(&workers->lock);
+    parser_free(p);
+    return NULL;
+}
+
+ /*
+  * parsepages
+  *  parses the pages of a mapped input with several threads. The pages and
+  *  their errors are added in page order, so the result is the same as
+  *  parsing them one at a time.
+  */
+static void parsepages(struct Parser *p, struct array *pages) {
+    struct Workers workers;
+    pthread_t *ids;
+    int i, count, length;
+    workers.doc = p->doc;
+    workers.jobs = scanpages(p);
+    workers.next = 0;
+    workers.fontschanged = 0;
+    workers.caller = pthread_self();
+    workers.cpu = 0;
+    pthread_mutex_init(&workers.lock, NULL);
+    length = array_length(workers.jobs);
+    count = (p->doc->threads < length) ? p->doc->threads : length;
+    ids = malloc(sizeof(pthread_t) * (count + 1));
+    for (i = 1; i < count; i++) {
+	if (pthread_create(&ids[i], NULL, parseworker, &workers))
+	    break;
+    }
+    count = i;
+    parseworker(&workers);
+    for (i = 1; i < count; i++)
+	pthread_join(ids[i], NULL);
+    free(ids);
+    pthread_mutex_destroy(&workers.lock);
+    p->fontschanged |= workers.fontschanged;
+    stats_addcpu(p->doc->stats, workers.cpu);
+    for (i = 0; i < length; i++) {
+	struct PageJob *job = array_elementat(workers.jobs, i);
+	if (job->errtext) {
+	    fwrite(job->errtext, 1, job->errsize, stderr);
+	    free(job->errtext);
+	}
+	if (job->page)
+	    array_append_element(pages, job->page);
+    }
+    array_free(workers.jobs);
+    free(p->doc->fontlines);
+    p->doc->fontlines = NULL;
+    p->doc->fontlinecount = 0;
+}
+
  /*
   * parsepdf2xml
   *  parses a pdf2xml text file
   */
-struct array *parsepdf2xml(FILE *file, char *buf) {
-    char *cur;
+struct array *parsepdf2xml(struct Parser *p) {
+    struct Input *in = p->in;
+    char *buf, *cur;
     int endlen = strlen(PDF2XML_END);
     struct array *pages = array_special_init(&procs, 0, NULL);
     array_set_contains_pointers(pages, 1);
-    while (mygets(buf, BUFSIZE, file)) {
-	cur = skipwhite(buf);
-	if (!strncmp(cur, "<page", 5)) {
-	    struct Page *page = parse_page(file, buf, cur);
+    if (in->map && p->doc->threads > 1) {
+	parsepages(p, pages);
+	return pages;
+    }
+    while ((buf = mygets(p))) {
+	cur = skipwhite(buf, in->lineend);
+	if (startswith(cur, in->lineend, "<page", 5)) {
+	    struct Page *page = parse_page(p, cur);
 	    if (!page) {
 		
 	    } else {
 		array_append_element(pages, page);
 	    }
-	} else if (!strncmp(cur, PDF2XML_END, endlen)) {
+	} else if (startswith(cur, in->lineend, PDF2XML_END, endlen)) {
 	    return pages;
 	}
     }
@@ -353,35 +922,103 @@ struct array *parsepdf2xml(FILE *file, char *buf) {
 }
 
  /*
-  * parse_pdf2xml
-  *  parses a pdf2xml text file
-  *  returns a array of Pages
+  * updatefonts
+  *  the texts keep the size of their font, read it again if a font was
+  *  defined after a text using it, or changed size
   */
-struct array *parse_pdf2xml(FILE *file) {
-    char *buf = malloc(BUFSIZE);
+static void updatefonts(struct Doc *doc, struct array *pages) {
+    int i, j, length = array_length(pages);
+    for (i = 0; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	int count = page_length(page);
+	for (j = 0; j < count; j++)
+	    text_updatefont(doc, page_textat(page, j));
+    }
+}
+
+ /*
+  * parse
+  *  parses the pdf2xml document of in, which belongs to doc
+  *  returns a array of Pages, they belong to doc
+  */
+static struct array *parse(struct Doc *doc, struct Input *in) {
+    struct Parser parser;
+    struct Parser *p = &parser;
     int xmllen = strlen(PDF2XML);
-    char *ret, *cur;
+    char *buf, *cur;
     struct array *pages = NULL;
     
-    parse_init();
+    parser_init(p, doc, in, stderr);
     
-    while ((ret = mygets(buf, BUFSIZE, file))) {
-	cur = skipwhite(buf);
-	if (!strncmp(cur, "<?xml", 5)) {
-	    parsexmltag(cur);
-	} else if (!strncmp(cur,"<!DOCTYPE", 9)) {
+    while ((buf = mygets(p))) {
+	cur = skipwhite(buf, in->lineend);
+	if (startswith(cur, in->lineend, "<?xml", 5)) {
+	    parsexmltag(p, cur, in->lineend);
+	} else if (startswith(cur, in->lineend, "<!DOCTYPE", 9)) {
 	
-	} else if (!strncmp(cur, PDF2XML, xmllen)) {
-	    pages = parsepdf2xml(file, buf);
+	} else if (startswith(cur, in->lineend, PDF2XML, xmllen)) {
+	    pages = parsepdf2xml(p);
+	    if (p->fontschanged)
+		updatefonts(doc, pages);
 	    break;
-	} else if (*cur == '\n' || !*cur) {
+	} else if (cur == in->lineend || *cur == '\n' || !*cur) {
 	
+	} else if (in->map) {
+	    fprintf(stderr, "Unknown input at line %d: %.*s\n", p->lineno, (int)(in->lineend - buf), buf);
 	} else {
-	    fprintf(stderr, "Unknown input at line %d: %s", lineno, buf);
+	    fprintf(stderr, "Unknown input at line %d: %s", p->lineno, buf);
 	}
     }
-    free(buf);
+    parser_free(p);
+    free(in->buf);
+    in->buf = NULL;
+    doc->pages = pages;
     return pages;
 }
 
+ /*
+  * parse_pdf2xml
+  *  parses a pdf2xml text file
+  *  returns a array of Pages, they belong to doc
+  */
+struct array *parse_pdf2xml(struct Doc *doc, FILE *file) {
+    pthread_once(&parse_once, parse_init);
+    parse_free(doc);
+    doc->input = malloc(sizeof(struct Input));
+    input_open(doc->input, file);
+    return parse(doc, doc->input);
+}
+
+ /*
+  * parse_pdf2xmlbuffer
+  *  parses a pdf2xml document of length bytes in buf, which must outlive
+  *  the pages. returns a array of Pages, they belong to doc
+  */
+struct array *parse_pdf2xmlbuffer(struct Doc *doc, const char *buf, size_t length) {
+    pthread_once(&parse_once, parse_init);
+    parse_free(doc);
+    doc->input = malloc(sizeof(struct Input));
+    input_openbuffer(doc->input, buf, length);
+    return parse(doc, doc->input);
+}
 
+ /*
+  * parse_free
+  *  frees the pages of the document, then releases its input, the text
+  *  objects point into it.
+  */
+void parse_free(struct Doc *doc) {
+    if (doc->pages)
+	array_free(doc->pages);
+    doc->pages = NULL;
+    if (doc->input) {
+	input_close(doc->input);
+	free(doc->input);
+	doc->input = NULL;
+    }
+    free(doc->encoding);
+    doc->encoding = NULL;
+    free(doc->fontlines);
+    doc->fontlines = NULL;
+    doc->fontlinecount = 0;
+}
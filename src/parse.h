@@ -25,16 +25,38 @@
 
 #include <stdio.h>
 struct array;
+struct Doc;
  /*
   * parse_pdf2xml
   *  parses a pdf2xml text file
-  *  returns a array of Pages
+  *  returns a array of Pages, they belong to doc
   */
-struct array *parse_pdf2xml(FILE *file);
+struct array *parse_pdf2xml(struct Doc *doc, FILE *file);
+ /*
+  * parse_pdf2xmlbuffer
+  *  parses a pdf2xml document of length bytes in buf, which must outlive
+  *  the pages. returns a array of Pages, they belong to doc
+  */
+struct array *parse_pdf2xmlbuffer(struct Doc *doc, const char *buf, size_t length);
  /*
   * parse_encoding
   *  returns the character encoding
   */
-char *parse_encoding();
+char *parse_encoding(struct Doc *doc);
+ /*
+  * parse_setthreads
+  *  number of threads used to parse the pages of a memory mapped input
+  */
+void parse_setthreads(struct Doc *doc, int count);
+ /*
+  * parse_inputsize
+  *  returns the number of bytes of input read
+  */
+size_t parse_inputsize(struct Doc *doc);
+ /*
+  * parse_free
+  *  frees the pages of the document and releases its input
+  */
+void parse_free(struct Doc *doc);
 
 #endif /* INCLUDED_PARSE_H */
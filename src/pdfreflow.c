@@ -26,13 +26,11 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <getopt.h>
-#include "html.h"
-#include "rect.h"
-#include "font.h"
-#include "page.h"
-#include "parse.h"
+#include <pthread.h>
+#include <sys/stat.h>
+#include "reflow.h"
+#include "server.h"
 #include "array.h"
-#include "hashtable.h"
 
 
 
@@ -42,6 +40,7 @@ debugusage() {
 Debug usage: pdfreflow [debug_options] < inputfile \n\
 Debugging Options:\n\
       --bounds		print bounding rect of each page\n\
+      --diag=FILE	print the debugging output to FILE instead of stderr\n\
   -C, --chapterfs=SIZE	minimum fontsize for chapter header (default is 20)\n\
       --chapters	print chapters found, showing page number\n\
       --fonts		print all the fonts in document\n\
@@ -66,7 +65,7 @@ Debugging Options:\n\
 static void
 usage(int retval) {
     fprintf(stderr, "\n\
-usage: pdfreflow [options] [inputfile] \n\
+usage: pdfreflow [options] [inputfile ...] \n\
 Options:\n\
       --absolute	font sizes are the same as the original document\n\
                         (not the default) the default is to remap fonts to\n\
@@ -77,14 +76,25 @@ Options:\n\
   -d, --dontreflow=PAGES don't reflow comma separated page ranges,\n\
 			i.e. \"1,2,4-9,100\"\n\
   -f, --first=FIRSTPAGE starting page (default is 1)\n\
+  -j, --jobs=N		parse pages with N threads (default is 1)\n\
   -l, --last=LASTPAGE	ending page (default is last page of the document)\n\
+  -m, --manifest=FILE	convert the input files listed in FILE, one per line\n\
       --nonfiction	for books that use block quoting at the same inset\n\
 			as the paragraph indent\n\
   -r, --ragright	text is rag-right, NOT justify (default is justify)\n\
   -s, --shortlines	paragraphs end with short lines (only necessary\n\
 			for rag right documents with no paragraph indent\n\
 			and no after paragraph vertical spacing.\n\
+      --stats[=json]	print the wall and cpu time of each phase, the number\n\
+			of pages, texts and lines, MB/s and peak memory,\n\
+			as text or as a json object per input file\n\
   -t, --top=MINTOP	crop text whose top is less than or equal to mintop\n\
+  -w, --workers=N	convert N input files at once (default is 1)\n\
+\n\
+      --server=SOCKET	serve conversion jobs on a unix domain socket, -w\n\
+			jobs at once. see server.h for the protocol\n\
+      --timeout=SECS	server jobs are stopped after SECS seconds\n\
+      --memlimit=MB	server jobs may use at most MB megabytes\n\
 \n\
       --showdebug	print debugging options\n\
   -v, --version		print current version\n\
@@ -94,6 +104,10 @@ If inputfile is specified, file suffix is replace with .html and the \n\
 ouput is written to that file. I.E. an input file of ~/mybook.xml has an\n\
 output file ~/mybook.html. \n\
 \n\
+When several input files are given, each is converted the same way, the\n\
+largest first. An error in one file is reported, and the others are still\n\
+converted.\n\
+\n\
 If no input file is specified, stdin used as the input, and stdout is\n\
 the output.\n\
 \n");
@@ -101,61 +115,54 @@ the output.\n\
 }
 
 
-static int absolute = 0;
-static int fontsize = 20;
-static int showchapters = 0;
-static int showpagenums = 0;
-static int showfonts = 0;
-static int showfontsize = 0;
-static int showleading = 0;
-static int showlineheight = 0;
-static int showleft = 0;
-static int showright = 0;
-static int firstpage = 0;
-static int lastpage = -1;
-static int showxml = 0;
-static int showbounds = 0;
-static int showx = 0;
-static char *inputname = NULL;
-static int showstyles = 0;
-static int showpara = 0;
+static struct ReflowOptions options;
+static struct array *inputnames = NULL;
+static char *manifest = NULL;
+static char *diag = NULL;
+static int workers = 1;
+static char *server = NULL;
+static int timeout = 0;
+static long memlimit = 0;
 static int showdebug = 0;
 static int showhelp = 0;
-static int center_page = 0;
-static int center_line = 0;
-static int printpage = 0;
-static int nonfiction = 0;
-static int shortlines = -1;
 
  /* argument for getopt_long, for command line processing */
 struct option longopts[] = {
-    { "absolute",   no_argument, &absolute, 1 },
+    { "absolute",   no_argument, &options.absolute, 1 },
     { "bottom",	    required_argument, NULL, 'b' },
-    { "bounds",	    no_argument, &showbounds, 1 },
+    { "bounds",	    no_argument, &options.showbounds, 1 },
     { "center",	    required_argument, NULL, 'c' },
     { "chapterfs",  required_argument, NULL, 'C' },
-    { "chapters",   no_argument, &showchapters, 1 },
+    { "chapters",   no_argument, &options.showchapters, 1 },
+    { "diag",	    required_argument, NULL, 'D' },
     { "dontreflow", required_argument, NULL, 'd' },
     { "first",	    required_argument, NULL, 'f' },
-    { "fonts",	    no_argument, &showfonts, 1 },
-    { "fontsize",   no_argument, &showfontsize, 1 },
+    { "fonts",	    no_argument, &options.showfonts, 1 },
+    { "fontsize",   no_argument, &options.showfontsize, 1 },
     { "help",	    no_argument, &showhelp, 1 },
+    { "jobs",	    required_argument, NULL, 'j' },
     { "last",	    required_argument, NULL, 'l' },
-    { "leading",    no_argument, &showleading, 1 },
-    { "lineheight", no_argument, &showlineheight, 1 },
-    { "left",	    no_argument, &showleft, 1 },
-    { "nonfiction", no_argument, &nonfiction, 1 },
-    { "pageno",	    no_argument, &showpagenums, 1 },
+    { "manifest",   required_argument, NULL, 'm' },
+    { "memlimit",   required_argument, NULL, 'M' },
+    { "leading",    no_argument, &options.showleading, 1 },
+    { "lineheight", no_argument, &options.showlineheight, 1 },
+    { "left",	    no_argument, &options.showleft, 1 },
+    { "nonfiction", no_argument, &options.nonfiction, 1 },
+    { "pageno",	    no_argument, &options.showpagenums, 1 },
     { "print",	    required_argument, NULL, 'p' },
     { "ragright",   no_argument, NULL, 'r' },
     { "shortlines", required_argument, NULL, 's' },
     { "showdebug",   no_argument, &showdebug, 1 },
-    { "showpara",   no_argument, &showpara, 1 },
-    { "showstyles", no_argument, &showstyles, 1 },
-    { "right",	    no_argument, &showright, 1 },
+    { "showpara",   no_argument, &options.showpara, 1 },
+    { "showstyles", no_argument, &options.showstyles, 1 },
+    { "stats",	    optional_argument, NULL, 'X' },
+    { "right",	    no_argument, &options.showright, 1 },
+    { "server",	    required_argument, NULL, 'S' },
+    { "timeout",    required_argument, NULL, 'T' },
     { "top",	    required_argument, NULL, 't' },
-    { "xbounds",    no_argument, &showx, 1 },
-    { "xml",	    no_argument, &showxml, 1 },
+    { "workers",    required_argument, NULL, 'w' },
+    { "xbounds",    no_argument, &options.showx, 1 },
+    { "xml",	    no_argument, &options.showxml, 1 },
     { "version",    no_argument, NULL, 'v' },
     {0}
 };
@@ -182,28 +189,73 @@ static void parsecenter(char *str) {
 	exit(3);
     }
     *colon = 0;
-    center_page = strtol(str, NULL, 10);
-    if (!center_page) {
+    options.centerpage = strtol(str, NULL, 10);
+    if (!options.centerpage) {
 	fprintf(stderr, "invalid page number: %s\n", str);
 	exit(3);
     }
-    center_line = strtol(colon + 1, NULL, 10);
-    if (!center_line) {
+    options.centerline = strtol(colon + 1, NULL, 10);
+    if (!options.centerline) {
 	fprintf(stderr, "invalid line number: %s\n", colon + 1);
 	exit(3);
     }
 }
 
+ /*
+  * readmanifest
+  *  add the input files listed in name, one per line, to inputnames. blank
+  *  lines are skipped
+  */
+static void readmanifest(char *name) {
+    char line[4096];
+    FILE *file = fopen(name, "r");
+    if (!file) {
+	fprintf(stderr, "Unable to open manifest %s.\n", name);
+	exit(1);
+    }
+    while (fgets(line, sizeof(line), file)) {
+	int length = strcspn(line, "\r\n");
+	line[length] = 0;
+	if (length)
+	    array_append_element(inputnames, strdup(line));
+    }
+    fclose(file);
+}
+
+/* options of the command line that have no meaning in a server job */
+#define SERVEROPTIONS "DmMSTvw"
+
+ /*
+  * optionname
+  *  returns the long name of the option whose getopt value is ch
+  */
+static const char *optionname(int ch) {
+    struct option *cur;
+    for (cur = longopts; cur->name; cur++) {
+	if (!cur->flag && cur->val == ch)
+	    return cur->name;
+    }
+    return "";
+}
+
  /*
   * readargs
-  *  parse command line arguments into a bunch of statics
+  *  parse command line arguments into options and a bunch of statics, which
+  *  are only read after this. when job is set these are the options of a
+  *  server job, which can not name input files or set the options of the
+  *  server process. returns 0, or REFLOW_ERROR_OPTIONS for such a job
   */
-static void readargs(int argc, char **argv) {
+static int readargs(int argc, char **argv, int job) {
+    const char *invalid = NULL;
     int ch;
-    while ((ch = getopt_long(argc, argv, "rvb:cC::d:f:l:p:s:t:", longopts, NULL)) != EOF) {
+    while ((ch = getopt_long(argc, argv, "rvb:cC::d:f:j:l:m:p:s:t:w:", longopts, NULL)) != EOF) {
+	if (job && ch && strchr(SERVEROPTIONS, ch)) {
+	    invalid = optionname(ch);
+	    continue;
+	}
 	switch (ch) {
 	    case 'b':
-		page_cropbottom(strtol(optarg, NULL, 10));
+		options.cropbottom = strtol(optarg, NULL, 10);
 		break;
 	    case 0:
 		break;
@@ -211,28 +263,59 @@ static void readargs(int argc, char **argv) {
 		parsecenter(optarg);
 		break;
 	    case 'C':
-		fontsize = strtol(optarg, NULL, 10);
+		options.chapterfs = strtol(optarg, NULL, 10);
 		break;
 	    case 'd':
-		setPageRange(optarg);
+		options.dontreflow = optarg;
+		break;
+	    case 'D':
+		diag = optarg;
 		break;
 	    case 'f':
-		firstpage = strtol(optarg, NULL, 10) - 1;
+		options.firstpage = strtol(optarg, NULL, 10) - 1;
+		break;
+	    case 'j':
+		options.threads = strtol(optarg, NULL, 10);
 		break;
 	    case 'l':
-		lastpage = strtol(optarg, NULL, 10);
+		options.lastpage = strtol(optarg, NULL, 10);
+		break;
+	    case 'm':
+		manifest = optarg;
+		break;
+	    case 'M':
+		memlimit = strtol(optarg, NULL, 10);
+		break;
+	    case 'S':
+		server = optarg;
+		break;
+	    case 'T':
+		timeout = strtol(optarg, NULL, 10);
+		break;
+	    case 'X':
+		if (!optarg || !strcmp(optarg, "text"))
+		    options.showstats = REFLOW_STATS_TEXT;
+		else if (!strcmp(optarg, "json"))
+		    options.showstats = REFLOW_STATS_JSON;
+		else {
+		    fprintf(stderr, "Invalid stats format %s\n", optarg);
+		    usage(1);
+		}
 		break;
 	    case 'p':
-		printpage = strtol(optarg, NULL, 10);
+		options.printpage = strtol(optarg, NULL, 10);
 		break;
 	    case 'r':
-		page_setrag();
+		options.ragright = 1;
 		break;
 	    case 's':
-		shortlines = strtol(optarg, NULL, 10);
+		options.shortlines = strtol(optarg, NULL, 10);
 		break;
 	    case 't':
-		page_croptop(strtol(optarg, NULL, 10));
+		options.croptop = strtol(optarg, NULL, 10);
+		break;
+	    case 'w':
+		workers = strtol(optarg, NULL, 10);
 		break;
 	    case 'v':
 		showversion();
@@ -244,511 +327,319 @@ static void readargs(int argc, char **argv) {
     }
     argc -= optind;
     argv += optind;
-    if (firstpage < 0) {
-	fprintf(stderr, "Invalid first page %d\n", firstpage);
+    if (options.firstpage < 0) {
+	fprintf(stderr, "Invalid first page %d\n", options.firstpage);
+	usage(1);
+    }
+    if (options.lastpage >= 0 && options.lastpage < options.firstpage) {
+	fprintf(stderr, "Invalid lastpage page %d\n", options.lastpage);
 	usage(1);
     }
-    if (lastpage >= 0 && lastpage < firstpage) {
-	fprintf(stderr, "Invalid lastpage page %d\n", lastpage);
+    if (workers < 1) {
+	fprintf(stderr, "Invalid worker count %d\n", workers);
 	usage(1);
     }
-    if (argc)
-	inputname = argv[0];
+    if (job) {
+	if (showhelp)
+	    invalid = "help";
+	else if (showdebug)
+	    invalid = "showdebug";
+	if (invalid) {
+	    fprintf(stderr, "Option --%s can not be used in a server job.\n", invalid);
+	    return REFLOW_ERROR_OPTIONS;
+	}
+	if (argc) {
+	    fprintf(stderr, "A server job can not name input files, %s is not an option.\n", *argv);
+	    return REFLOW_ERROR_OPTIONS;
+	}
+	return 0;
+    }
+    inputnames = array_pointer_init(0);
+    for (; argc; argc--, argv++)
+	array_append_element(inputnames, *argv);
+    if (manifest)
+	readmanifest(manifest);
     if (showhelp)
 	usage(0);
     if (showdebug)
 	debugusage();
+    return 0;
 }
 
  /*
-  * printbounds
-  *  print bounds of pages
-  */
-static void printbounds(struct array *pages) {
-    int i, length = array_length(pages);
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	struct Rect r = page_textbounds(page);
-	fprintf(stderr, "page %3d: t: %3d, l:%3d, w:%3d, h:%3d\n", i+1, r.top, r.left, r.width, r.height);
-    }
-}
-
- /*
-  * printxml
-  *  print xml content of pages
-  */
-static void printxml(struct array *pages) {
-    int i, length = array_length(pages);
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	page_print(page);
-    }
-}
-
- /*
-  * printpagenums
-  *  print the page number found in the text of the pages
+  * getoutputfile
+  *  open output file replacing .xml with .html
+  *  if no file name, return standard out. returns NULL on error
   */
-static void printpagenums(struct array *pages) {
-    int i, length = array_length(pages);
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	page_printpageno(page);
-    }
+static FILE *getoutputfile(char *inputname) {
+    char *name, *period, *slash;
+    FILE *file;
+    if (!inputname)
+	return stdout;
+    name = malloc(strlen(inputname) + sizeof(".html"));
+    strcpy(name, inputname);
+    period = strrchr(name, '.');
+    slash = strrchr(name, '/');
+    if (!period || period < slash)
+	strcat(name, ".html");
+    else
+	strcpy(period, ".html");
+    file = fopen(name, "w");
+    if (!file)
+	fprintf(stderr, "Unable to open %s for writing.\n", name);
+    free(name);
+    return file;
 }
 
  /*
-  * printchapters
-  *  print the page number of chapter headings based on font size heuristic
+  * getinputfile
+  *  get input file. If not input name specified, use standard in
+  *  returns NULL on error
   */
-static void printchapters(struct array *pages) {
-    int i, length = array_length(pages);
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	page_printchapter(page, fontsize);
-    }
+static FILE *getinputfile(char *inputname) {
+    FILE *file;
+    if (!inputname)
+	return stdin;
+    file = fopen(inputname, "r");
+    if (!file)
+	fprintf(stderr, "Unable to open input file %s.\n", inputname);
+    return file;
 }
 
  /*
-  * frequency
-  *  struct used for frequency analysis
+  * struct Output
+  *  the html output of an input file, opened when the first html is written
   */
-struct frequency {
-    int val;		/* value of stuff being analyzed for frequency */
-    int count;		/* the number of value that occurred */
+struct Output {
+    char *inputname;
+    FILE *file;
 };
 
  /*
-  * frequency_compare
-  *  qsort call back to sort frequency in ascending orders
+  * writeoutput
+  *  write callback for the html of a conversion, opens the output file
+  *  of the input the first time
   */
-static int frequency_compare(const void *p1, const void *p2) {
-    struct frequency *s1 = (struct frequency *)p1;
-    struct frequency *s2 = (struct frequency *)p2;
-    if (s1->count < s2->count)
-	return 1;
-    else if (s2->count < s1->count)
-	return -1;
-    if (s1->val < s2->val)
-	return -1;
-    if (s1->val > s2->val)
+static int writeoutput(void *context, const char *data, size_t length) {
+    struct Output *output = context;
+    if (!output->file && !(output->file = getoutputfile(output->inputname)))
 	return 1;
-	
-    return 0;
+    return fwrite(data, 1, length, output->file) != length;
 }
 
-#define FREQSIZE 3	/* the number of saved frequency values from the last call to printfreq */
-
-static struct frequency lastfreq[FREQSIZE]; /* saved frequency values */
-
  /*
-  * printfreq
-  *  do frequency analysis, and print up to 10 of the max frequencies found
+  * debugging
+  *  returns true if a debugging option asks for output instead of the html
   */
-static int printfreq(struct hashtable *hash, char *title, int print, int val_is_str, int bias) {
-    int i, length;
-    int retval = -1;
-    struct array *keys, *vals;
-    struct frequency keyval;
-    struct frequency *ptr;
-
-    keys = hashtable_keys(hash, 0);
-    vals = array_init(sizeof(struct frequency), 0);
-    length = array_length(keys);
-    for (i = 0; i < length; i++) {
-	void *key = array_elementat(keys, i);
-	void *val = hashtable_get(hash, key);
-	keyval.val = (int)key;
-	keyval.count = (int)val;
-	array_append_element(vals, &keyval);
-    }
-    qsort(array_elementat(vals, 0), length, sizeof(struct frequency), frequency_compare);
-/*
-    if (length > 10)
-	length = 10;
-*/
-    memset(lastfreq, 0, sizeof(lastfreq));
-    
-    for (i = 0; i < length; i++) {
-	ptr = array_elementat(vals, i);
-	if (i == 0) 
-	    retval = ptr->val - bias;
-	if (i < FREQSIZE) {
-	    lastfreq[i].val = ptr->val - bias;
-	    lastfreq[i].count = ptr->count;
-	}
-	if (print) {
-	    if (val_is_str)
-		fprintf(stderr, "%s: %s, count: %d\n", title, (char *)ptr->val, ptr->count);
-	    else
-		fprintf(stderr, "%s: %d, count: %d\n", title, ptr->val - bias, ptr->count);
-	}
-    }
-    array_free(vals);
-    array_free(keys);
-    return retval;
+static int debugging() {
+    return options.showpagenums + options.showchapters + options.showfonts +
+	options.showfontsize + options.showleft + options.showright +
+	options.showxml + options.showbounds + options.showleading +
+	options.showx + options.showlineheight + options.printpage;
 }
 
  /*
-  * checkindent
-  *  this must be called right after analyzeleft to work, as it uses some statics that were
-  *  left behind by printfreq.
-  *  tries some heuristics to see if we can deduce what the left indent xposition is.
+  * convert
+  *  parse and process one input file, standard in if inputname is NULL
+  *  returns 0, or the exit status of an error
   */
-static void checkindent(int lineheight) {
-    int indent_to_line_ratio, indent, leftmargin;
-    int linedelta, delta = 30;
-    int marginindex = 1;
+static int convert(char *inputname) {
+    struct ReflowOptions fileoptions = options;
+    struct Output output;
+    FILE *file;
+    int status;
     
-    /* if there is only xpos in the whole doc, then there can't be any left indent */
-    if (lastfreq[1].count == 0)
-	return;
-    /* there should be more than 1/14 the number of leftmargin lines */
-    indent_to_line_ratio = lastfreq[0].count / 14;
-    if (lastfreq[1].count < indent_to_line_ratio)
-	return;
-    /* see if the 3rd value is a better fit. If so, try it instead */
-    if (lastfreq[2].count != 0 && lastfreq[2].count >= indent_to_line_ratio) {
-	marginindex = 2;
+    file = getinputfile(inputname);
+    if (!file)
+	return 1;
+    fileoptions.name = inputname;
+    output.inputname = inputname;
+    output.file = NULL;
+    if (inputname || !debugging())
+	status = reflow_convertfile(file, &fileoptions, writeoutput, &output);
+    else
+	status = reflow_convertfile(file, &fileoptions, NULL, NULL);
+    if (output.file && output.file != stdout && fclose(output.file) && !status) {
+	fprintf(stderr, "Unable to write the html of %s.\n", inputname);
+	status = 1;
     }
-    /*
-     * calculate a delta based on lineheight, roughly 5 spaces, where the width is 60% of
-     * lineheight
-     */
-    linedelta = (5 * lineheight * 6) / 10;
-    if (linedelta > delta)
-	delta = linedelta;
-    indent = lastfreq[marginindex].val;
-    leftmargin = lastfreq[0].val;
-    /* is indent reasonable (within 5 spaces of left margin, greater than leftmargin) */
-    if (indent <= leftmargin || indent > (leftmargin + delta))
-	return;
-    page_setindent(indent);
+    if (file != stdin)
+	fclose(file);
+    return status;
 }
 
  /*
-  * gethash
-  *  returns a hashtable where the keys are pointers
+  * writefile
+  *  write callback for the html of a server job, context is the FILE
   */
-static struct hashtable *gethash() {
-    struct hashtable *hash = hashtable_create(0);
-    hashtable_set_keys_are_pointers(hash);
-    return hash;
+static int writefile(void *context, const char *data, size_t length) {
+    return fwrite(data, 1, length, context) != length;
 }
 
  /*
-  * enumpages
-  *  enumerate though pages and collect information for frequency analysis
+  * serverconvert
+  *  runs in the child process of a server job. the options of the job are
+  *  read over those of the server command line, and the html goes to out.
+  *  returns 0, or the exit status of an error, REFLOW_ERROR_OPTIONS for an
+  *  option that only the server command line can give
   */
-static int enumpages(struct array *pages, void (*proc)(struct Page *page, struct hashtable *hash), char *title, int print, int val_is_str, int bias) {
-    int i, length = array_length(pages);
-    int retval = -1;
-    struct hashtable *hash = gethash();
-    int start = 0;
+static int serverconvert(struct ServerJob *job, FILE *out) {
+    int i, argc = array_length(job->options) + 1;
+    char **argv = malloc(sizeof(char *) * (argc + 1));
+    FILE *file;
+    int status;
     
-    start = firstpage;
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = start; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	proc(page, hash);
+    argv[0] = "pdfreflow";
+    for (i = 1; i < argc; i++)
+	argv[i] = array_elementat(job->options, i - 1);
+    argv[argc] = NULL;
+    optind = 0;
+    if ((status = readargs(argc, argv, 1))) {
+	free(argv);
+	return status;
     }
-    retval = printfreq(hash, title, print, val_is_str, bias);
-    hashtable_free(hash);
-    return retval;
-}
-
- /*
-  * getleft
-  *  callback to get left position for --left debug option
-  */
-static void getleft(struct Page *page, struct hashtable *hash) {
-    page_getleft(page, hash);
-}
-
- /*
-  * getright
-  *  callback to get right position for --right debug option
-  */
-static void getright(struct Page *page, struct hashtable *hash) {
-    page_getright(page, hash);
-}
-
- /*
-  * getfontsize
-  *  callback to get right position for --fontsize debug option
-  */
-static void getfontsize(struct Page *page, struct hashtable *hash) {
-    page_getfontsize(page, hash);
-}
-
-#define LEADING_BIAS 100
- /*
-  * getleading
-  *  callback to get line leading position for --leading debug option
-  */
-static void getleading(struct Page *page, struct hashtable *hash) {
-    page_getleadings(page, hash, LEADING_BIAS);
-}
-
- /*
-  * analyzeleading
-  *  get the most frequent leading, and possibly print some debugging info
-  */
-static int analyzeleading(struct array *pages, int print) {
-    return enumpages(pages, getleading, "leading", print, 0, LEADING_BIAS);
-}
-
- /*
-  * getlineheight
-  *  callback to get lineheight position for --lineheight debug option
-  */
-static void getlineheight(struct Page *page, struct hashtable *hash) {
-    page_getlineheight(page, hash);
-}
-
- /*
-  * analyzelineheight
-  *  get the most frequent lineheight, and possibly print some debugging info
-  */
-static int analyzelineheight(struct array *pages, int print) {
-    return enumpages(pages, getlineheight, "height", print, 0, 0);
-}
-
- /*
-  * analyzeleft
-  *  get the most frequent left position, and possibly print some debugging info
-  */
-static int analyzeleft(struct array *pages, int print) {
-    return enumpages(pages, getleft, "left", print, 0, 0);
-}
-
- /*
-  * analyzeright
-  *  get the most frequent right position, and possibly print some debugging info
-  */
-static int analyzeright(struct array *pages, int print) {
-    return enumpages(pages, getright, "right", print, 0, 0);
-}
-
- /*
-  * analyzefontsize
-  *  get the most frequent fontsize, and possibly print some debugging info
-  */
-static int analyzefontsize(struct array *pages, int print) {
-    return enumpages(pages, getfontsize, "fontsize", print, 1, 0);
-}
+    options.name = job->input;
+    if (!job->input)
+	status = reflow_convert(job->xml, job->xmllen, &options, writefile, out);
+    else if ((file = getinputfile(job->input))) {
+	status = reflow_convertfile(file, &options, writefile, out);
+	fclose(file);
+    } else
+	status = 1;
+    free(argv);
+    return status;
+}
+
+ /*
+  * struct Job
+  *  an input file of a batch, and the status of its conversion
+  */
+struct Job {
+    char *name;
+    off_t size;
+    int status;
+};
 
  /*
-  * printx
-  *  print minx/maxx of pages
+  * struct Batch
+  *  the jobs shared by the worker threads, next is the next job to convert
   */
-static void printx(struct array *pages) {
-    int i, length = array_length(pages);
-    struct hashtable *mins = gethash();
-    struct hashtable *maxs = gethash();
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	struct Page *page = array_elementat(pages, i);
-	struct Bounds b = rect_to_bounds(page_textbounds(page));
-	fprintf(stderr, "page %3d: minx: %3d, maxx:%3d\n", i+1, b.minx, b.maxx);
-	put_int(mins, b.minx, 1);
-	put_int(maxs, b.maxx, 1);
-    }
-    fprintf(stderr, "\nmin x freq:\n");
-    printfreq(mins, "minx", 1, 0, 0);
-    fprintf(stderr, "\nmax x freq:\n");
-    printfreq(maxs, "maxx", 1, 0, 0);
-    hashtable_free(mins);
-    hashtable_free(maxs);
-}
+struct Batch {
+    struct Job *jobs;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+};
 
  /*
-  * getoutputfile
-  *  open output file replacing .xml with .html
-  *  if no file name, return standard out
+  * jobcompare
+  *  qsort comparison proc, largest file first
   */
-static FILE *getoutputfile() {
-    char name[1024], *period;
-    FILE *file;
-    if (!inputname)
-	return stdout;
-    strcpy(name, inputname);
-    period = strrchr(name, '.');
-    if (!period)
-	strcat(name, ".html");
-    else
-	strcpy(period, ".html");
-    file = fopen(name, "w");
-    if (!file) {
-	fprintf(stderr, "Unable to open %s for writing.\n", name);
-	exit(1);
-    }
-    return file;
+static int jobcompare(const void *p1, const void *p2) {
+    const struct Job *j1 = p1;
+    const struct Job *j2 = p2;
+    if (j1->size > j2->size)
+	return -1;
+    if (j1->size < j2->size)
+	return 1;
+    return 0;
 }
 
  /*
-  * findcenter
-  *  uses the --center argument to discover the center X pos of the document
+  * batchworker
+  *  thread proc, converts jobs until there are none left
   */
-static void findcenter(struct array *pages) {
-    struct Page *page = array_elementat(pages, center_page - 1);
-    if (!page) {
-	fprintf(stderr, "Invalid page number: %d\n", center_page);
-	exit(3);
+static void *batchworker(void *context) {
+    struct Batch *batch = context;
+    for (;;) {
+	struct Job *job;
+	pthread_mutex_lock(&batch->lock);
+	job = (batch->next < batch->count) ? batch->jobs + batch->next++ : NULL;
+	pthread_mutex_unlock(&batch->lock);
+	if (!job)
+	    break;
+	job->status = convert(job->name);
     }
-    page_setcenter(page, center_line - 1);
+    return NULL;
 }
 
  /*
-  * printpara
-  *  print paragraph groups in pages
+  * convertall
+  *  convert the input files with up to "workers" threads, the largest first.
+  *  a failed file is reported, and does not stop the others.
+  *  returns 0, the status of a single file, or 1 if any file failed
   */
-static void printpara(struct array *pages) {
-    int i, lineheight, length = array_length(pages);
-    struct array *texts = array_pointer_init(0);
-    struct hashtable *pagestarts = hashtable_create(0);
-    struct Rect maxbounds = {0};
-    struct Rect bounds = {0};
-    struct Page *page;
-    struct Rect minbounds = {0};
-    struct Atom *defaultfont;
-    FILE *file = getoutputfile();
+static int convertall(struct array *names) {
+    struct Batch batch;
+    pthread_t *ids;
+    int i, count, failed = 0;
     
-    if (center_line && center_page)
-	findcenter(pages);
-    lineheight = analyzelineheight(pages, 0);
-    minbounds.left = analyzeleft(pages, 0);
-    checkindent(lineheight);
-    minbounds.width = analyzeright(pages, 0) - minbounds.left;
-    page_setlineleading(analyzeleading(pages, 0));
-    page_setlineheight(lineheight);
-    defaultfont = (struct Atom *)analyzefontsize(pages, 0);
-    html_setdefaultfont(defaultfont);
-    hashtable_set_keys_are_pointers(pagestarts);
-    if (lastpage > 0 && lastpage < length)
-	length = lastpage;
-    for (i = firstpage; i < length; i++) {
-	page = array_elementat(pages, i);
-	page_initpara(page, minbounds);
-    }
-    for (i = firstpage; i < length; i++) {
-	page = array_elementat(pages, i);
-	bounds = page_textbounds(page);
-	page_printpara(page, minbounds, texts, pagestarts);
-	if (i == firstpage)
-	    maxbounds = bounds;
-	else
-	    maxbounds = rect_add(maxbounds, bounds);
+    batch.count = array_length(names);
+    batch.next = 0;
+    batch.jobs = calloc(batch.count + 1, sizeof(struct Job));
+    for (i = 0; i < batch.count; i++) {
+	struct stat st;
+	batch.jobs[i].name = array_elementat(names, i);
+	if (!stat(batch.jobs[i].name, &st))
+	    batch.jobs[i].size = st.st_size;
     }
-    page_multipleparas(file, texts, pagestarts, minbounds);
-}
-
-
- /*
-  * printsummary
-  *  print encoding and number of pages parsed and processed
-  */
-static void printsummary(struct array *pages) {
-    int length = array_length(pages);
-    int viewedpages = length;
-
-    if (lastpage > 0 && lastpage < length)
-	viewedpages = lastpage - firstpage;
-    fprintf(stderr, "Encoding: %s\n", parse_encoding());
-    fprintf(stderr, "%d pages parsed, %d pages processed.\n", length, viewedpages);
-}
-
- /*
-  * getinputfile
-  *  get input file. If not input name specified, use standard in
-  */
-static FILE *getinputfile() {
-    FILE *file;
-    if (!inputname)
-	return stdin;
-    file = fopen(inputname, "r");
-    if (!file) {
-	fprintf(stderr, "Unable to open input file %s.\n", inputname);
-	exit(1);
+    qsort(batch.jobs, batch.count, sizeof(struct Job), jobcompare);
+    pthread_mutex_init(&batch.lock, NULL);
+    count = (workers < batch.count) ? workers : batch.count;
+    ids = malloc(sizeof(pthread_t) * (count + 1));
+    for (i = 1; i < count; i++) {
+	if (pthread_create(&ids[i], NULL, batchworker, &batch))
+	    break;
     }
-    return file;
-}
-
- /*
-  * printpagecontent
-  *  print the text lines of a page
-  */
-static void printpagecontent(struct array *pages) {
-    int length = array_length(pages);
-    struct Page *page;
-    int realpage = printpage - 1;
-    if (realpage < 0 || realpage >= length) {
-	fprintf(stderr, "page %d is out of range (1 - %d)\n", printpage, length + 1);
-	exit(2);
+    count = i;
+    batchworker(&batch);
+    for (i = 1; i < count; i++)
+	pthread_join(ids[i], NULL);
+    free(ids);
+    pthread_mutex_destroy(&batch.lock);
+    if (batch.count == 1)
+	failed = batch.jobs[0].status;
+    else {
+	for (i = 0; i < batch.count; i++) {
+	    if (batch.jobs[i].status) {
+		fprintf(stderr, "Conversion of %s failed.\n", batch.jobs[i].name);
+		failed = 1;
+	    }
+	}
     }
-    page = array_elementat(pages, realpage);
-    page_printcontents(page, stderr);
+    free(batch.jobs);
+    return failed;
 }
 
  /*
-  * main - parse command line, parse xml file, and execute various options
+  * main - parse command line, parse xml files, and execute various options
   */
 int main(int argc, char **argv) {
-    struct array *pages;
+    int status;
     
-    readargs(argc, argv);
-    pages = parse_pdf2xml(getinputfile());
-    if (pages) {
-	if (shortlines >= 0)
-	    page_setshortlines(shortlines ? shortlines : 80);
-	if (nonfiction)
-	    page_setnonfiction();
-	if (absolute)
-	    html_setabsolute();
-	if (showstyles)
-	    html_setshowstyle();
-	if (showpara)
-	    page_setshowpara();
-	printsummary(pages);
-	if (showpagenums)
-	    printpagenums(pages);
-	if (showchapters)
-	    printchapters(pages);
-	if (showfonts)
-	    font_printfonts();
-	if (showfontsize)
-	    analyzefontsize(pages, 1);
-	if (showleading)
-	    analyzeleading(pages, 1);
-	if (showlineheight)
-	    analyzelineheight(pages, 1);
-	if (showleft)
-	    analyzeleft(pages, 1);
-	if (showright)
-	    analyzeright(pages, 1);
-	if (showxml)
-	    printxml(pages);
-	if (showbounds)
-	    printbounds(pages);
-	if (showx)
-	    printx(pages);
-	if (printpage)
-	    printpagecontent(pages);
-	if (!(showpagenums + showchapters + showfonts + showfontsize + 
-	    showleft + showright + showxml + showbounds + showleading +
-	    showx + showlineheight + printpage)  || inputname)
-	    printpara(pages);
-	array_free(pages);
+    reflow_initoptions(&options);
+    options.showsummary = 1;
+    readargs(argc, argv, 0);
+    if (diag && !(options.diag = fopen(diag, "w"))) {
+	fprintf(stderr, "Unable to open %s for writing.\n", diag);
+	return 1;
     }
-    return 0;
+    if (server) {
+	struct ServerConfig config;
+	config.path = server;
+	config.workers = workers;
+	config.timeout = timeout;
+	config.memlimit = memlimit;
+	config.convert = serverconvert;
+	return server_run(&config);
+    }
+    if (array_length(inputnames))
+	status = convertall(inputnames);
+    else
+	status = convert(NULL);
+    if (options.diag && fclose(options.diag) && !status) {
+	fprintf(stderr, "Unable to write %s.\n", diag);
+	status = 1;
+    }
+    return status;
 }
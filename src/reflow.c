@@ -0,0 +1,627 @@
+/*
+ * reflow.c
+ *
+ * Copyright (C) 2010 Pranananda Deva
+ *
+ * This file is part of pdfreflow.
+ *
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "reflow.h"
+#include "doc.h"
+#include "html.h"
+#include "rect.h"
+#include "font.h"
+#include "page.h"
+#include "parse.h"
+#include "array.h"
+#include "hashtable.h"
+#include "histogram.h"
+#include "linetable.h"
+#include "sink.h"
+#include "stats.h"
+
+ /*
+  * reflow_initoptions
+  *  set options to the defaults of the command line
+  */
+void reflow_initoptions(struct ReflowOptions *options) {
+    memset(options, 0, sizeof(struct ReflowOptions));
+    options->lastpage = -1;
+    options->shortlines = -1;
+    options->croptop = -1;
+    options->cropbottom = -1;
+    options->threads = 1;
+    options->chapterfs = 20;
+}
+
+ /*
+  * reflow_strerror
+  *  returns a description of a reflow_status
+  */
+const char *reflow_strerror(int status) {
+    switch (status) {
+	case REFLOW_OK:
+	    return "no error";
+	case REFLOW_ERROR_IO:
+	    return "unable to read the input or write the html";
+	case REFLOW_ERROR_PAGE:
+	    return "page to print is not in the document";
+	case REFLOW_ERROR_CENTER:
+	    return "page of the centered line is not in the document";
+	case REFLOW_ERROR_XML:
+	    return "input is not a pdf2xml document";
+	case REFLOW_ERROR_OPTIONS:
+	    return "invalid options";
+	case REFLOW_ERROR_MEMORY:
+	    return "out of memory";
+    }
+    return "unknown error";
+}
+
+ /*
+  * checkoptions
+  *  returns REFLOW_ERROR_OPTIONS if the page range of options is invalid
+  */
+static int checkoptions(const struct ReflowOptions *options) {
+    if (options->firstpage < 0) {
+	fprintf(stderr, "Invalid first page %d\n", options->firstpage);
+	return REFLOW_ERROR_OPTIONS;
+    }
+    if (options->lastpage >= 0 && options->lastpage < options->firstpage) {
+	fprintf(stderr, "Invalid lastpage page %d\n", options->lastpage);
+	return REFLOW_ERROR_OPTIONS;
+    }
+    return REFLOW_OK;
+}
+
+ /*
+  * setoptions
+  *  apply the options that change how doc is parsed and reflowed
+  */
+static void setoptions(struct Doc *doc, const struct ReflowOptions *options) {
+    parse_setthreads(doc, options->threads);
+    if (options->cropbottom >= 0)
+	page_cropbottom(doc, options->cropbottom);
+    if (options->croptop >= 0)
+	page_croptop(doc, options->croptop);
+    if (options->ragright)
+	page_setrag(doc);
+    if (options->dontreflow) {
+	/* setPageRange cuts up its argument */
+	char *range = strdup(options->dontreflow);
+	setPageRange(doc, range);
+	free(range);
+    }
+    if (options->shortlines >= 0)
+	page_setshortlines(doc, options->shortlines ? options->shortlines : 80);
+    if (options->nonfiction)
+	page_setnonfiction(doc);
+    if (options->absolute)
+	html_setabsolute(doc);
+    if (options->showstyles)
+	html_setshowstyle(doc);
+    if (options->showpara)
+	page_setshowpara(doc);
+}
+
+ /*
+  * lastpageof
+  *  returns the index after the last page of pages to look at
+  */
+static int lastpageof(struct array *pages, const struct ReflowOptions *options) {
+    int length = array_length(pages);
+    if (options->lastpage > 0 && options->lastpage < length)
+	length = options->lastpage;
+    return length;
+}
+
+ /*
+  * printbounds
+  *  print bounds of pages
+  */
+static void printbounds(struct Doc *doc, const struct ReflowOptions *options) {
+    struct array *pages = doc->pages;
+    int i, length = lastpageof(pages, options);
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	struct Rect r = page_textbounds(page);
+	sink_printf(doc->diag, "page %3d: t: %3d, l:%3d, w:%3d, h:%3d\n", i+1, r.top, r.left, r.width, r.height);
+    }
+}
+
+ /*
+  * printxml
+  *  print xml content of pages
+  */
+static void printxml(struct array *pages, const struct ReflowOptions *options) {
+    int i, length = lastpageof(pages, options);
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	page_print(page);
+    }
+}
+
+ /*
+  * printpagenums
+  *  print the page number found in the text of the pages
+  */
+static void printpagenums(struct array *pages, const struct ReflowOptions *options) {
+    int i, length = lastpageof(pages, options);
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	page_printpageno(page);
+    }
+}
+
+ /*
+  * printchapters
+  *  print the page number of chapter headings based on font size heuristic
+  */
+static void printchapters(struct array *pages, const struct ReflowOptions *options) {
+    int i, length = lastpageof(pages, options);
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	page_printchapter(page, options->chapterfs);
+    }
+}
+
+#define FREQSIZE 3	/* the number of frequency values printfreq can return in top */
+
+ /*
+  * printfreq
+  *  do frequency analysis, and print all the frequencies found, most frequent first.
+  *  when not printing only the top FREQSIZE values are looked at. if top is set, the
+  *  FREQSIZE most frequent values, less bias, are returned in it.
+  */
+static int printfreq(struct Doc *doc, struct histogram *hist, char *title, int print, int val_is_str, int bias, struct histogram_entry *top) {
+    int i, length;
+    int retval = -1;
+    struct histogram_entry freq[FREQSIZE];
+    struct histogram_entry *vals = freq;
+    struct histogram_entry *ptr;
+
+    if (top)
+	memset(top, 0, FREQSIZE * sizeof(struct histogram_entry));
+    if (print) {
+	length = histogram_length(hist);
+	vals = malloc((length + 1) * sizeof(struct histogram_entry));
+    } else
+	length = FREQSIZE;
+    length = histogram_top(hist, vals, length);
+    for (i = 0; i < length; i++) {
+	ptr = vals + i;
+	if (i == 0)
+	    retval = ptr->val - bias;
+	if (top && i < FREQSIZE) {
+	    top[i].val = ptr->val - bias;
+	    top[i].count = ptr->count;
+	}
+	if (print) {
+	    if (val_is_str)
+		sink_printf(doc->diag, "%s: %s, count: %d\n", title, (char *)font_printstr(doc, ptr->val), ptr->count);
+	    else
+		sink_printf(doc->diag, "%s: %d, count: %d\n", title, ptr->val - bias, ptr->count);
+	}
+    }
+    if (vals != freq)
+	free(vals);
+    return retval;
+}
+
+ /*
+  * checkindent
+  *  left is the most frequent left positions, as returned by analyzeleft.
+  *  tries some heuristics to see if we can deduce what the left indent xposition is.
+  */
+static void checkindent(struct Doc *doc, struct histogram_entry *left, int lineheight) {
+    int indent_to_line_ratio, indent, leftmargin;
+    int linedelta, delta = 30;
+    int marginindex = 1;
+
+    /* if there is only xpos in the whole doc, then there can't be any left indent */
+    if (left[1].count == 0)
+	return;
+    /* there should be more than 1/14 the number of leftmargin lines */
+    indent_to_line_ratio = left[0].count / 14;
+    if (left[1].count < indent_to_line_ratio)
+	return;
+    /* see if the 3rd value is a better fit. If so, try it instead */
+    if (left[2].count != 0 && left[2].count >= indent_to_line_ratio) {
+	marginindex = 2;
+    }
+    /*
+     * calculate a delta based on lineheight, roughly 5 spaces, where the width is 60% of
+     * lineheight
+     */
+    linedelta = (5 * lineheight * 6) / 10;
+    if (linedelta > delta)
+	delta = linedelta;
+    indent = left[marginindex].val;
+    leftmargin = left[0].val;
+    /* is indent reasonable (within 5 spaces of left margin, greater than leftmargin) */
+    if (indent <= leftmargin || indent > (leftmargin + delta))
+	return;
+    page_setindent(doc, indent);
+}
+
+#define LEADING_BIAS 100
+
+ /*
+  * getlayout
+  *  enumerate though pages once and collect the left, right, fontsize, lineheight
+  *  and leading frequencies together. the result is kept in doc for later callers.
+  */
+static struct Layout *getlayout(struct Doc *doc, const struct ReflowOptions *options) {
+    struct array *pages = doc->pages;
+    struct Layout *layout = doc->layout;
+    int i, length = lastpageof(pages, options);
+
+    if (layout)
+	return layout;
+    layout = doc->layout = malloc(sizeof(struct Layout));
+    layout->bias = LEADING_BIAS;
+    layout->left = histogram_create();
+    layout->right = histogram_create();
+    layout->fontsize = histogram_create();
+    layout->lineheight = histogram_create();
+    layout->leading = histogram_create();
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	page_getlayout(page, layout);
+    }
+    return layout;
+}
+
+ /*
+  * analyzeleading
+  *  get the most frequent leading, and possibly print some debugging info
+  */
+static int analyzeleading(struct Doc *doc, const struct ReflowOptions *options, int print) {
+    return printfreq(doc, getlayout(doc, options)->leading, "leading", print, 0, LEADING_BIAS, NULL);
+}
+
+ /*
+  * analyzelineheight
+  *  get the most frequent lineheight, and possibly print some debugging info
+  */
+static int analyzelineheight(struct Doc *doc, const struct ReflowOptions *options, int print) {
+    return printfreq(doc, getlayout(doc, options)->lineheight, "height", print, 0, 0, NULL);
+}
+
+ /*
+  * analyzeleft
+  *  get the most frequent left position, and possibly print some debugging info.
+  *  the FREQSIZE most frequent positions are returned in top, if set
+  */
+static int analyzeleft(struct Doc *doc, const struct ReflowOptions *options, int print, struct histogram_entry *top) {
+    return printfreq(doc, getlayout(doc, options)->left, "left", print, 0, 0, top);
+}
+
+ /*
+  * analyzeright
+  *  get the most frequent right position, and possibly print some debugging info
+  */
+static int analyzeright(struct Doc *doc, const struct ReflowOptions *options, int print) {
+    return printfreq(doc, getlayout(doc, options)->right, "right", print, 0, 0, NULL);
+}
+
+ /*
+  * analyzefontsize
+  *  get the most frequent fontsize, and possibly print some debugging info
+  */
+static int analyzefontsize(struct Doc *doc, const struct ReflowOptions *options, int print) {
+    return printfreq(doc, getlayout(doc, options)->fontsize, "fontsize", print, 1, 0, NULL);
+}
+
+ /*
+  * printx
+  *  print minx/maxx of pages
+  */
+static void printx(struct Doc *doc, const struct ReflowOptions *options) {
+    struct array *pages = doc->pages;
+    int i, length = lastpageof(pages, options);
+    struct histogram *mins = histogram_create();
+    struct histogram *maxs = histogram_create();
+    for (i = options->firstpage; i < length; i++) {
+	struct Page *page = array_elementat(pages, i);
+	struct Bounds b = rect_to_bounds(page_textbounds(page));
+	sink_printf(doc->diag, "page %3d: minx: %3d, maxx:%3d\n", i+1, b.minx, b.maxx);
+	histogram_add(mins, b.minx);
+	histogram_add(maxs, b.maxx);
+    }
+    sink_puts(doc->diag, "\nmin x freq:\n");
+    printfreq(doc, mins, "minx", 1, 0, 0, NULL);
+    sink_puts(doc->diag, "\nmax x freq:\n");
+    printfreq(doc, maxs, "maxx", 1, 0, 0, NULL);
+    histogram_free(mins);
+    histogram_free(maxs);
+}
+
+ /*
+  * findcenter
+  *  uses the centerpage and centerline options to discover the center X pos
+  *  of the document. returns REFLOW_OK, or REFLOW_ERROR_CENTER if the page
+  *  does not exist
+  */
+static int findcenter(struct array *pages, const struct ReflowOptions *options) {
+    struct Page *page = NULL;
+    if (options->centerpage <= array_length(pages))
+	page = array_elementat(pages, options->centerpage - 1);
+    if (!page) {
+	fprintf(stderr, "Invalid page number: %d\n", options->centerpage);
+	return REFLOW_ERROR_CENTER;
+    }
+    page_setcenter(page, options->centerline - 1);
+    return REFLOW_OK;
+}
+
+ /*
+  * printpara
+  *  print paragraph groups in pages, as html to sink
+  *  returns a reflow_status
+  */
+static int printpara(struct Doc *doc, const struct ReflowOptions *options, struct Sink *sink) {
+    struct array *pages = doc->pages;
+    int i, lineheight, length = lastpageof(pages, options);
+    struct array *texts, *lines;
+    struct hashtable *pagestarts;
+    struct Rect maxbounds = {0};
+    struct Rect bounds = {0};
+    struct Page *page;
+    struct Rect minbounds = {0};
+    struct histogram_entry left[FREQSIZE];
+    int defaultfont;
+
+    if (options->centerline && options->centerpage && findcenter(pages, options))
+	return REFLOW_ERROR_CENTER;
+    texts = array_pointer_init(0);
+    lines = linetable_init();
+    pagestarts = hashtable_create(length - options->firstpage);
+    stats_begin(doc->stats, STATS_SORT);
+    for (i = options->firstpage; i < length; i++)
+	page_sort(array_elementat(pages, i));
+    stats_begin(doc->stats, STATS_ANALYZE);
+    lineheight = analyzelineheight(doc, options, 0);
+    minbounds.left = analyzeleft(doc, options, 0, left);
+    checkindent(doc, left, lineheight);
+    minbounds.width = analyzeright(doc, options, 0) - minbounds.left;
+    page_setlineleading(doc, analyzeleading(doc, options, 0));
+    page_setlineheight(doc, lineheight);
+    defaultfont = analyzefontsize(doc, options, 0);
+    html_setdefaultfont(doc, defaultfont);
+    hashtable_set_keys_are_pointers(pagestarts);
+    stats_begin(doc->stats, STATS_SEGMENT);
+    for (i = options->firstpage; i < length; i++)
+	page_initpara(array_elementat(pages, i), minbounds);
+    for (i = options->firstpage; i < length; i++) {
+	page = array_elementat(pages, i);
+	bounds = page_textbounds(page);
+	page_printpara(page, minbounds, texts, lines, pagestarts);
+	if (i == options->firstpage)
+	    maxbounds = bounds;
+	else
+	    maxbounds = rect_add(maxbounds, bounds);
+    }
+    if (doc->stats) {
+	doc->stats->pages = (length > options->firstpage) ? length - options->firstpage : 0;
+	doc->stats->texts = array_length(texts);
+	doc->stats->lines = array_length(lines);
+    }
+    sink_flush(doc->diag);
+    page_multipleparas(doc, sink, texts, lines, pagestarts, minbounds);
+    sink_flush(doc->diag);
+    stats_end(doc->stats);
+    hashtable_free(pagestarts);
+    array_free(lines);
+    array_free(texts);
+    return REFLOW_OK;
+}
+
+ /*
+  * printsummary
+  *  print encoding and number of pages parsed and processed
+  */
+static void printsummary(struct Doc *doc, const struct ReflowOptions *options) {
+    int length = array_length(doc->pages);
+    int viewedpages = length;
+
+    if (options->lastpage > 0 && options->lastpage < length)
+	viewedpages = options->lastpage - options->firstpage;
+    sink_printf(doc->diag, "Encoding: %s\n", parse_encoding(doc));
+    sink_printf(doc->diag, "%d pages parsed, %d pages processed.\n", length, viewedpages);
+}
+
+ /*
+  * printpagecontent
+  *  print the text lines of a page
+  *  returns REFLOW_OK, or REFLOW_ERROR_PAGE if the page does not exist
+  */
+static int printpagecontent(struct Doc *doc, const struct ReflowOptions *options) {
+    struct array *pages = doc->pages;
+    int length = array_length(pages);
+    struct Page *page;
+    int realpage = options->printpage - 1;
+    if (realpage < 0 || realpage >= length) {
+	fprintf(stderr, "page %d is out of range (1 - %d)\n", options->printpage, length + 1);
+	return REFLOW_ERROR_PAGE;
+    }
+    page = array_elementat(pages, realpage);
+    page_printcontents(page, doc->diag);
+    return REFLOW_OK;
+}
+
+ /*
+  * process
+  *  execute the debugging options on a parsed document, then print its html to
+  *  sink, if it is set. returns a reflow_status
+  */
+static int process(struct Doc *doc, const struct ReflowOptions *options, struct Sink *sink) {
+    struct array *pages = doc->pages;
+    int status = REFLOW_OK;
+
+    if (options->showsummary)
+	printsummary(doc, options);
+    if (options->showpagenums)
+	printpagenums(pages, options);
+    if (options->showchapters)
+	printchapters(pages, options);
+    if (options->showfonts)
+	font_printfonts(doc);
+    if (options->showfontsize)
+	analyzefontsize(doc, options, 1);
+    if (options->showleading)
+	analyzeleading(doc, options, 1);
+    if (options->showlineheight)
+	analyzelineheight(doc, options, 1);
+    if (options->showleft)
+	analyzeleft(doc, options, 1, NULL);
+    if (options->showright)
+	analyzeright(doc, options, 1);
+    if (options->showxml)
+	printxml(pages, options);
+    if (options->showbounds)
+	printbounds(doc, options);
+    if (options->showx)
+	printx(doc, options);
+    sink_flush(doc->diag);
+    if (options->printpage && (status = printpagecontent(doc, options)))
+	return status;
+    if (sink)
+	status = printpara(doc, options, sink);
+    return status;
+}
+
+ /*
+  * writediag
+  *  write proc of the debugging reports, context is the FILE they go to
+  */
+static int writediag(void *context, const char *data, size_t length) {
+    return fwrite(data, 1, length, context) != length;
+}
+
+ /*
+  * convert
+  *  parse the document of file, or of length bytes in xml if file is NULL,
+  *  and convert it. returns a reflow_status
+  */
+static int convert(FILE *file, const char *xml, size_t length, const struct ReflowOptions *options, reflow_write write, void *context) {
+    struct Stats stats;
+    struct Sink *sink = NULL;
+    struct Doc *doc;
+    int status;
+
+    if ((status = checkoptions(options)))
+	return status;
+    if (!file && !xml)
+	return REFLOW_ERROR_XML;
+    if (!(doc = doc_create()))
+	return REFLOW_ERROR_MEMORY;
+    setoptions(doc, options);
+    if (options->showstats) {
+	stats_init(&stats);
+	doc->stats = &stats;
+    }
+    stats_begin(doc->stats, STATS_PARSE);
+    if (file)
+	parse_pdf2xml(doc, file);
+    else
+	parse_pdf2xmlbuffer(doc, xml, length);
+    stats_end(doc->stats);
+    if (!doc->pages) {
+	fprintf(stderr, "Input is not a pdf2xml document.\n");
+	doc_free(doc);
+	return REFLOW_ERROR_XML;
+    }
+    if (!(doc->diag = malloc(sizeof(struct Sink))) || (write && !(sink = malloc(sizeof(struct Sink))))) {
+	free(doc->diag);
+	doc_free(doc);
+	return REFLOW_ERROR_MEMORY;
+    }
+    sink_init(doc->diag, writediag, options->diag ? options->diag : stderr);
+    if (sink)
+	sink_init(sink, write, context);
+    status = process(doc, options, sink);
+    if (sink) {
+	if (sink_flush(sink) && !status)
+	    status = REFLOW_ERROR_IO;
+	free(sink);
+    }
+    sink_flush(doc->diag);
+    free(doc->diag);
+    doc->diag = NULL;
+    if (doc->stats && !status) {
+	stats.bytes = parse_inputsize(doc);
+	stats_print(&stats, options->name, stderr, options->showstats == REFLOW_STATS_JSON);
+    }
+    doc_free(doc);
+    return status;
+}
+
+ /*
+  * reflow_convert
+  *  convert the pdf2xml document of length bytes in xml. the html is passed
+  *  to write, or not made if write is NULL. returns a reflow_status
+  */
+int reflow_convert(const char *xml, size_t length, const struct ReflowOptions *options, reflow_write write, void *context) {
+    return convert(NULL, xml, length, options, write, context);
+}
+
+ /*
+  * reflow_convertfile
+  *  like reflow_convert, reading the document from file. regular files are
+  *  memory mapped. returns a reflow_status
+  */
+int reflow_convertfile(FILE *file, const struct ReflowOptions *options, reflow_write write, void *context) {
+    return convert(file, NULL, 0, options, write, context);
+}
+
+ /*
+  * appendbuffer
+  *  write callback of reflow_convertbuffer, appends to a ReflowBuffer
+  */
+static int appendbuffer(void *context, const char *data, size_t length) {
+    struct ReflowBuffer *out = context;
+    if (out->length + length > out->size) {
+	size_t size = out->size ? out->size : SINKSIZE;
+	char *grown;
+	while (size < out->length + length)
+	    size *= 2;
+	if (!(grown = realloc(out->data, size)))
+	    return 1;
+	out->data = grown;
+	out->size = size;
+    }
+    memcpy(out->data + out->length, data, length);
+    out->length += length;
+    return 0;
+}
+
+ /*
+  * reflow_convertbuffer
+  *  convert the pdf2xml document of length bytes in xml, appending the html
+  *  to out. returns a reflow_status
+  */
+int reflow_convertbuffer(const char *xml, size_t length, const struct ReflowOptions *options, struct ReflowBuffer *out) {
+    int status = convert(NULL, xml, length, options, appendbuffer, out);
+    /* nothing is read from a file, so only growing out can fail */
+    if (status == REFLOW_ERROR_IO)
+	status = REFLOW_ERROR_MEMORY;
+    return status;
+}
@@ -0,0 +1,161 @@
+/*
+ * reflow.h
+ *
+ * Copyright (C) 2010 Pranananda Deva
+ *
+ * This file is part of pdfreflow.
+ *
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * libpdfreflow, the conversion of pdfreflow without the command line.
+  * link with -lpdfreflow -lpthread. each call converts one document with
+  * its own state, so documents may be converted on several threads at once.
+  * warnings about the input are printed to stderr.
+  *
+  * the installed library is one partially linked object in which only the
+  * names starting with reflow_ are global. the build makes all the other
+  * names local with objcopy, so a program may use names such as
+  * array_length or page_sort itself. where configure finds no objcopy the
+  * internal names stay global.
+  */
+
+#ifndef INCLUDED_REFLOW_H
+#define INCLUDED_REFLOW_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ /*
+  * reflow_status
+  *  the results of a conversion, the same as the exit status of pdfreflow
+  */
+enum reflow_status {
+    REFLOW_OK = 0,
+    REFLOW_ERROR_IO = 1,	/* unable to read the input or write the html */
+    REFLOW_ERROR_PAGE = 2,	/* printpage is not a page of the document */
+    REFLOW_ERROR_CENTER = 3,	/* centerpage is not a page of the document */
+    REFLOW_ERROR_XML = 4,	/* the input is not a pdf2xml document */
+    REFLOW_ERROR_OPTIONS = 5,	/* invalid options */
+    REFLOW_ERROR_MEMORY = 6	/* out of memory */
+};
+
+/* values of ReflowOptions.showstats */
+#define REFLOW_STATS_TEXT 1
+#define REFLOW_STATS_JSON 2
+
+ /*
+  * ReflowOptions
+  *  how a document is converted, the options of the command line. set up
+  *  with reflow_initoptions, then change what is needed.
+  */
+struct ReflowOptions {
+    int firstpage;		/* first page converted, starting at 0 */
+    int lastpage;		/* last page converted, starting at 1, -1 for all */
+    int ragright;		/* text is rag-right, not justified */
+    int nonfiction;		/* block quotes have the paragraph indent */
+    int shortlines;		/* percent of a line that ends a paragraph, 0 for
+				   80, -1 to not look at short lines */
+    int croptop;		/* crop text with a top at or above, -1 for none */
+    int cropbottom;		/* crop text with a top at or below, -1 for none */
+    const char *dontreflow;	/* page ranges not reflowed, "1,2,4-9", or NULL */
+    int centerpage;		/* page and line of a centered line, starting */
+    int centerline;		/*   at 1, 0 if not known */
+    int absolute;		/* keep the font sizes of the document */
+    int threads;		/* threads parsing the pages of the input */
+    const char *name;		/* name of the input in reports, or NULL */
+    int showstats;		/* REFLOW_STATS_TEXT or REFLOW_STATS_JSON prints the
+				   time of each phase to stderr, 0 for none */
+    FILE *diag;			/* where the debugging reports go, NULL for stderr */
+
+    /* debugging, printed to diag. the reports are buffered and written
+       at the end of each phase */
+    int showsummary;		/* the encoding and number of pages */
+    int chapterfs;		/* minimum fontsize of a chapter heading */
+    int showchapters;
+    int showpagenums;
+    int showfonts;
+    int showfontsize;
+    int showleading;
+    int showlineheight;
+    int showleft;
+    int showright;
+    int showxml;
+    int showbounds;
+    int showx;
+    int showstyles;
+    int showpara;
+    int printpage;		/* page whose text lines are printed, 0 for none */
+};
+
+ /*
+  * ReflowBuffer
+  *  a growable buffer for the html, data is grown with realloc and belongs to
+  *  the caller. start with all zero, or a malloced data to reuse.
+  */
+struct ReflowBuffer {
+    char *data;
+    size_t length;		/* bytes of html in data */
+    size_t size;		/* allocated size of data */
+};
+
+ /*
+  * reflow_write
+  *  receives the html in pieces, returns 0, or non zero to fail the conversion
+  */
+typedef int (*reflow_write)(void *context, const char *data, size_t length);
+
+ /*
+  * reflow_initoptions
+  *  set options to the defaults of the command line
+  */
+void reflow_initoptions(struct ReflowOptions *options);
+
+ /*
+  * reflow_convert
+  *  convert the pdf2xml document of length bytes in xml. the html is passed
+  *  to write, or not made if write is NULL. returns a reflow_status
+  */
+int reflow_convert(const char *xml, size_t length, const struct ReflowOptions *options, reflow_write write, void *context);
+
+ /*
+  * reflow_convertbuffer
+  *  convert the pdf2xml document of length bytes in xml, appending the html
+  *  to out. returns a reflow_status
+  */
+int reflow_convertbuffer(const char *xml, size_t length, const struct ReflowOptions *options, struct ReflowBuffer *out);
+
+ /*
+  * reflow_convertfile
+  *  like reflow_convert, reading the document from file. regular files are
+  *  memory mapped. returns a reflow_status
+  */
+int reflow_convertfile(FILE *file, const struct ReflowOptions *options, reflow_write write, void *context);
+
+ /*
+  * reflow_strerror
+  *  returns a description of a reflow_status
+  */
+const char *reflow_strerror(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDED_REFLOW_H */
@@ -0,0 +1,173 @@
+/*
+ * scan.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+const unsigned char scan_space[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1
+};
+
+ /*
+  * skipwhite_c, skiptoken_c
+  *  plain C scanners, also used for the tail of a line
+  */
+static char *skipwhite_c(char *cur, char *end) {
+    for (; cur < end; cur++) {
+	if (!scan_isspace(*cur))
+	    return cur;
+    }
+    return cur;
+}
+
+static char *skiptoken_c(char *cur, char *end, char endchar) {
+    for (; cur < end; cur++) {
+	if (scan_isspace(*cur) || *cur == endchar || !*cur)
+	    return cur;
+    }
+    return cur;
+}
+
+#ifdef SCAN_X86
+
+ /*
+  * the white space chars are ' ' and '\t' through '\r'. (ch - '\t') <= 4
+  * is done unsigned, with max_epu8.
+  */
+
+static char *skipwhite_sse2(char *cur, char *end) {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i blank = _mm_set1_epi8(' ');
+    for (; (end - cur) >= 16; cur += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)cur);
+	__m128i d = _mm_sub_epi8(v, tab);
+	__m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, blank),
+	    _mm_cmpeq_epi8(_mm_max_epu8(d, four), four));
+	int mask = ~_mm_movemask_epi8(space) & 0xffff;
+	if (mask)
+	    return cur + __builtin_ctz(mask);
+    }
+    return skipwhite_c(cur, end);
+}
+
+static char *skiptoken_sse2(char *cur, char *end, char endchar) {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i blank = _mm_set1_epi8(' ');
+    const __m128i stop = _mm_set1_epi8(endchar);
+    const __m128i zero = _mm_setzero_si128();
+    for (; (end - cur) >= 16; cur += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)cur);
+	__m128i d = _mm_sub_epi8(v, tab);
+	__m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, blank),
+	    _mm_cmpeq_epi8(_mm_max_epu8(d, four), four));
+	int mask;
+	hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(v, stop), _mm_cmpeq_epi8(v, zero)));
+	mask = _mm_movemask_epi8(hit);
+	if (mask)
+	    return cur + __builtin_ctz(mask);
+    }
+    return skiptoken_c(cur, end, endchar);
+}
+
+__attribute__((target("avx2")))
+static char *skipwhite_avx2(char *cur, char *end) {
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const __m256i blank = _mm256_set1_epi8(' ');
+    for (; (end - cur) >= 32; cur += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)cur);
+	__m256i d = _mm256_sub_epi8(v, tab);
+	__m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, blank),
+	    _mm256_cmpeq_epi8(_mm256_max_epu8(d, four), four));
+	unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(space);
+	if (mask)
+	    return cur + __builtin_ctz(mask);
+    }
+    return skipwhite_sse2(cur, end);
+}
+
+__attribute__((target("avx2")))
+static char *skiptoken_avx2(char *cur, char *end, char endchar) {
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const __m256i blank = _mm256_set1_epi8(' ');
+    const __m256i stop = _mm256_set1_epi8(endchar);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; (end - cur) >= 32; cur += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)cur);
+	__m256i d = _mm256_sub_epi8(v, tab);
+	__m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, blank),
+	    _mm256_cmpeq_epi8(_mm256_max_epu8(d, four), four));
+	unsigned int mask;
+	hit = _mm256_or_si256(hit, _mm256_or_si256(_mm256_cmpeq_epi8(v, stop), _mm256_cmpeq_epi8(v, zero)));
+	mask = (unsigned int)_mm256_movemask_epi8(hit);
+	if (mask)
+	    return cur + __builtin_ctz(mask);
+    }
+    return skiptoken_sse2(cur, end, endchar);
+}
+
+#endif /* SCAN_X86 */
+
+static char *(*skipwhite)(char *cur, char *end) = skipwhite_c;
+static char *(*skiptoken)(char *cur, char *end, char endchar) = skiptoken_c;
+
+ /*
+  * scan_init
+  *  picks the scanners for the cpu
+  */
+void scan_init() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	skipwhite = skipwhite_avx2;
+	skiptoken = skiptoken_avx2;
+    } else {
+	skipwhite = skipwhite_sse2;
+	skiptoken = skiptoken_sse2;
+    }
+#endif
+}
+
+ /*
+  * scan_skipwhite
+  *  returns the first char that is not white space, or end
+  */
+char *scan_skipwhite(char *cur, char *end) {
+    return skipwhite(cur, end);
+}
+
+ /*
+  * scan_skiptoken
+  *  returns the first white space, endchar or NUL, or end
+  */
+char *scan_skiptoken(char *cur, char *end, char endchar) {
+    return skiptoken(cur, end, endchar);
+}
@@ -0,0 +1,53 @@
+/*
+ * scan.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_SCAN_H
+#define INCLUDED_SCAN_H
+
+ /*
+  * scan_space
+  *  white space table, the same chars as isspace in the C locale
+  */
+extern const unsigned char scan_space[256];
+
+#define scan_isspace(ch) (scan_space[(unsigned char)(ch)])
+
+ /*
+  * scan_init
+  *  picks the scanners for the cpu, AVX2 or SSE2 when available, otherwise
+  *  plain C. Must be called before pages are parsed by several threads.
+  */
+void scan_init();
+
+ /*
+  * scan_skipwhite
+  *  returns the first char between cur and end that is not white space,
+  *  or end
+  */
+char *scan_skipwhite(char *cur, char *end);
+
+ /*
+  * scan_skiptoken
+  *  returns the first white space, endchar or NUL between cur and end, or end
+  */
+char *scan_skiptoken(char *cur, char *end, char endchar);
+
+#endif /* INCLUDED_SCAN_H */
@@ -0,0 +1,689 @@
+/*
+ * server.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "server.h"
+#include "array.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define CHUNKSIZE 65536		/* most html bytes sent in one chunk */
+#define LOGSIZE 65536		/* most stderr bytes of a job sent back */
+#define MAXREQUEST (64 * 1024 * 1024)	/* most bytes of a request line */
+
+ /*
+  * Client
+  *  a connection, and the buffers of the worker serving it. the buffers are
+  *  kept for the next connection.
+  */
+struct Client {
+    int fd;			/* the connection */
+    char *line;			/* the request being read */
+    int linesize;		/* allocated size of line */
+    int length;			/* bytes in line */
+    char *chunk;		/* html read from the job */
+    char *log;			/* stderr read from the job */
+    int loglength;		/* bytes in log */
+};
+
+ /*
+  * writeall
+  *  write all of buf to fd. returns 0, or -1 if the connection is gone
+  */
+static int writeall(int fd, const char *buf, int length) {
+    while (length > 0) {
+	ssize_t count = write(fd, buf, length);
+	if (count < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	buf += count;
+	length -= count;
+    }
+    return 0;
+}
+
+ /*
+  * skipspace
+  *  skip json white space
+  */
+static char *skipspace(char *cur, char *end) {
+    while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'))
+	cur++;
+    return cur;
+}
+
+ /*
+  * pututf8
+  *  encode a code point of a \u escape, returns the bytes written
+  */
+static int pututf8(char *out, unsigned int c) {
+    if (c < 0x80) {
+	out[0] = c;
+	return 1;
+    }
+    if (c < 0x800) {
+	out[0] = 0xc0 | (c >> 6);
+	out[1] = 0x80 | (c & 0x3f);
+	return 2;
+    }
+    if (c < 0x10000) {
+	out[0] = 0xe0 | (c >> 12);
+	out[1] = 0x80 | ((c >> 6) & 0x3f);
+	out[2] = 0x80 | (c & 0x3f);
+	return 3;
+    }
+    out[0] = 0xf0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3f);
+    out[2] = 0x80 | ((c >> 6) & 0x3f);
+    out[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+ /*
+  * gethex
+  *  the 4 hex digits of a \u escape, or -1
+  */
+static int gethex(char *cur, char *end) {
+    int i, val = 0;
+    if (end - cur < 4)
+	return -1;
+    for (i = 0; i < 4; i++) {
+	int c = cur[i];
+	val <<= 4;
+	if (c >= '0' && c <= '9')
+	    val |= c - '0';
+	else if (c >= 'a' && c <= 'f')
+	    val |= c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+	    val |= c - 'A' + 10;
+	else
+	    return -1;
+    }
+    return val;
+}
+
+ /*
+  * parsestring
+  *  parse a json string starting at the quote at *curp. returns a malloced
+  *  copy with the escapes decoded, or NULL if it is malformed
+  */
+static char *parsestring(char **curp, char *end, int *lengthp) {
+    char *cur = *curp + 1, *result, *out;
+    result = out = malloc(end - cur + 1);
+    while (cur < end && *cur != '"') {
+	if (*cur != '\\') {
+	    *out++ = *cur++;
+	    continue;
+	}
+	if (++cur >= end)
+	    break;
+	switch (*cur++) {
+	    case '"': *out++ = '"'; break;
+	    case '\\': *out++ = '\\'; break;
+	    case '/': *out++ = '/'; break;
+	    case 'b': *out++ = '\b'; break;
+	    case 'f': *out++ = '\f'; break;
+	    case 'n': *out++ = '\n'; break;
+	    case 'r': *out++ = '\r'; break;
+	    case 't': *out++ = '\t'; break;
+	    case 'u': {
+		int c = gethex(cur, end), low;
+		if (c < 0)
+		    goto error;
+		cur += 4;
+		/* a surrogate pair */
+		if (c >= 0xd800 && c < 0xdc00 && end - cur >= 6 && cur[0] == '\\' && cur[1] == 'u' &&
+		    (low = gethex(cur + 2, end)) >= 0xdc00 && low < 0xe000) {
+		    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+		    cur += 6;
+		}
+		out += pututf8(out, c);
+		break;
+	    }
+	    default:
+		goto error;
+	}
+    }
+    if (cur >= end)
+	goto error;
+    *out = 0;
+    *curp = cur + 1;
+    if (lengthp)
+	*lengthp = out - result;
+    return result;
+error:
+    free(result);
+    return NULL;
+}
+
+ /*
+  * skipvalue
+  *  skip a json value that is not used. returns NULL if it is malformed
+  */
+static char *skipvalue(char *cur, char *end, int depth) {
+    char *str;
+    cur = skipspace(cur, end);
+    if (cur >= end || depth > 32)
+	return NULL;
+    if (*cur == '"') {
+	if (!(str = parsestring(&cur, end, NULL)))
+	    return NULL;
+	free(str);
+	return cur;
+    }
+    if (*cur == '[' || *cur == '{') {
+	char close = (*cur == '[') ? ']' : '}';
+	cur = skipspace(cur + 1, end);
+	if (cur < end && *cur == close)
+	    return cur + 1;
+	for (;;) {
+	    if (close == '}') {
+		if (cur >= end || *cur != '"' || !(cur = skipvalue(cur, end, depth + 1)))
+		    return NULL;
+		cur = skipspace(cur, end);
+		if (cur >= end || *cur != ':')
+		    return NULL;
+		cur++;
+	    }
+	    if (!(cur = skipvalue(cur, end, depth + 1)))
+		return NULL;
+	    cur = skipspace(cur, end);
+	    if (cur < end && *cur == close)
+		return cur + 1;
+	    if (cur >= end || *cur != ',')
+		return NULL;
+	    cur = skipspace(cur + 1, end);
+	}
+    }
+    /* numbers, true, false and null */
+    str = cur;
+    while (cur < end && (isalnum((unsigned char)*cur) || *cur == '-' || *cur == '+' || *cur == '.'))
+	cur++;
+    return (cur == str) ? NULL : cur;
+}
+
+ /*
+  * parseoptions
+  *  parse the json array of option strings of a job
+  */
+static char *parseoptions(char *cur, char *end, struct array *options) {
+    char *str;
+    cur = skipspace(cur, end);
+    if (cur >= end || *cur != '[')
+	return NULL;
+    cur = skipspace(cur + 1, end);
+    if (cur < end && *cur == ']')
+	return cur + 1;
+    for (;;) {
+	if (cur >= end || *cur != '"' || !(str = parsestring(&cur, end, NULL)))
+	    return NULL;
+	array_append_element(options, str);
+	cur = skipspace(cur, end);
+	if (cur < end && *cur == ']')
+	    return cur + 1;
+	if (cur >= end || *cur != ',')
+	    return NULL;
+	cur = skipspace(cur + 1, end);
+    }
+}
+
+ /*
+  * job_free
+  *  frees the strings of a job
+  */
+static void job_free(struct ServerJob *job) {
+    int i;
+    free(job->input);
+    free(job->xml);
+    if (job->options) {
+	for (i = 0; i < array_length(job->options); i++)
+	    free(array_elementat(job->options, i));
+	array_free(job->options);
+    }
+    memset(job, 0, sizeof(struct ServerJob));
+}
+
+ /*
+  * parsejob
+  *  parse a request line into job. returns NULL, or a description of the error
+  */
+static char *parsejob(char *cur, char *end, struct ServerJob *job) {
+    memset(job, 0, sizeof(struct ServerJob));
+    job->options = array_pointer_init(0);
+    cur = skipspace(cur, end);
+    if (cur >= end || *cur != '{')
+	return "a job must be a json object";
+    cur = skipspace(cur + 1, end);
+    if (cur < end && *cur == '}')
+	cur = NULL;
+    while (cur) {
+	int keylength;
+	char *key;
+	if (cur >= end || *cur != '"' || !(key = parsestring(&cur, end, &keylength)))
+	    return "malformed json";
+	cur = skipspace(cur, end);
+	if (cur >= end || *cur != ':') {
+	    free(key);
+	    return "malformed json";
+	}
+	cur = skipspace(cur + 1, end);
+	if (!strcmp(key, "input") && cur < end && *cur == '"' && !job->input) {
+	    if (!(job->input = parsestring(&cur, end, NULL)))
+		cur = NULL;
+	} else if (!strcmp(key, "xml") && cur < end && *cur == '"' && !job->xml) {
+	    if (!(job->xml = parsestring(&cur, end, &job->xmllen)))
+		cur = NULL;
+	} else if (!strcmp(key, "options"))
+	    cur = parseoptions(cur, end, job->options);
+	else
+	    cur = skipvalue(cur, end, 0);
+	free(key);
+	if (!cur)
+	    return "malformed json";
+	cur = skipspace(cur, end);
+	if (cur < end && *cur == '}')
+	    break;
+	if (cur >= end || *cur != ',')
+	    return "malformed json";
+	cur = skipspace(cur + 1, end);
+    }
+    if (!job->input == !job->xml)
+	return "a job needs one of input or xml";
+    return NULL;
+}
+
+ /*
+  * putjson
+  *  append str to buf as the body of a json string. buf has room for 6
+  *  times the length of str
+  */
+static int putjson(char *buf, const char *str, int length) {
+    char *out = buf;
+    int i;
+    for (i = 0; i < length; i++) {
+	unsigned char c = str[i];
+	if (c == '"' || c == '\\') {
+	    *out++ = '\\';
+	    *out++ = c;
+	} else if (c == '\n') {
+	    *out++ = '\\';
+	    *out++ = 'n';
+	} else if (c < 0x20) {
+	    out += sprintf(out, "\\u%04x", c);
+	} else
+	    *out++ = c;
+    }
+    return out - buf;
+}
+
+ /*
+  * sendstatus
+  *  send the result of a job, with the error and stderr output of the job
+  */
+static int sendstatus(struct Client *client, int status, const char *error) {
+    int errlength = error ? strlen(error) : 0;
+    char *buf = malloc(64 + (errlength + client->loglength) * 6);
+    int length;
+    length = sprintf(buf, "{\"status\":%d", status);
+    if (error) {
+	length += sprintf(buf + length, ",\"error\":\"");
+	length += putjson(buf + length, error, errlength);
+	buf[length++] = '"';
+    }
+    if (client->loglength) {
+	length += sprintf(buf + length, ",\"log\":\"");
+	length += putjson(buf + length, client->log, client->loglength);
+	buf[length++] = '"';
+    }
+    length += sprintf(buf + length, "}\n");
+    status = writeall(client->fd, buf, length);
+    free(buf);
+    return status;
+}
+
+ /*
+  * closefds
+  *  the child gets every fd of the server, the sockets of the other connections,
+  *  the listening socket and the pipes of jobs other workers are starting. a
+  *  client only sees the end of its connection or job once every copy is
+  *  closed, so all of them are closed but for 0 to 2 and the html pipe, which
+  *  is moved to 3. returns the html pipe
+  */
+static int closefds(int out) {
+    int fd, max;
+    if (out != 3) {
+	dup2(out, 3);
+	close(out);
+    }
+#ifdef SYS_close_range
+    if (!syscall(SYS_close_range, 4, ~0U, 0))
+	return 3;
+#endif
+    max = sysconf(_SC_OPEN_MAX);
+    for (fd = 4; fd < max; fd++)
+	close(fd);
+    return 3;
+}
+
+ /*
+  * childjob
+  *  runs in the child process: set the limits, convert and exit
+  */
+static void childjob(struct ServerConfig *config, struct ServerJob *job, int out, int err) {
+    FILE *file;
+    int status;
+    if (config->memlimit > 0) {
+	struct rlimit limit;
+	limit.rlim_cur = limit.rlim_max = (rlim_t)config->memlimit * 1024 * 1024;
+	setrlimit(RLIMIT_AS, &limit);
+    }
+    dup2(err, 2);
+    close(err);
+    out = closefds(out);
+    file = fdopen(out, "w");
+    if (!file)
+	_exit(1);
+    status = config->convert(job, file);
+    fclose(file);
+    _exit(status);
+}
+
+ /*
+  * runjob
+  *  runs job in a child process, sending its html to the client as it is
+  *  written. the child is killed when it runs past the timeout.
+  *  returns 0, or -1 if the connection is gone
+  */
+static int runjob(struct ServerConfig *config, struct Client *client, struct ServerJob *job) {
+    int out[2], err[2];
+    int status, open = 2, timedout = 0, gone = 0;
+    char msg[100], *error = NULL;
+    struct timeval start, now;
+    pid_t pid;
+
+    client->loglength = 0;
+    if (pipe(out))
+	return sendstatus(client, 1, strerror(errno));
+    if (pipe(err)) {
+	close(out[0]);
+	close(out[1]);
+	return sendstatus(client, 1, strerror(errno));
+    }
+    pid = fork();
+    if (pid == 0) {
+	close(out[0]);
+	close(err[0]);
+	childjob(config, job, out[1], err[1]);
+    }
+    close(out[1]);
+    close(err[1]);
+    if (pid < 0) {
+	close(out[0]);
+	close(err[0]);
+	return sendstatus(client, 1, strerror(errno));
+    }
+    gettimeofday(&start, NULL);
+    while (open) {
+	struct pollfd fds[2];
+	int wait = -1, count;
+	fds[0].fd = out[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = err[0];
+	fds[1].events = POLLIN;
+	if (config->timeout > 0) {
+	    gettimeofday(&now, NULL);
+	    wait = config->timeout * 1000 - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000);
+	    if (wait <= 0) {
+		kill(pid, SIGKILL);
+		timedout = 1;
+		break;
+	    }
+	}
+	count = poll(fds, 2, wait);
+	if (count < 0 && errno != EINTR)
+	    break;
+	if (count <= 0)
+	    continue;
+	if (fds[0].fd >= 0 && fds[0].revents) {
+	    ssize_t length = read(out[0], client->chunk, CHUNKSIZE);
+	    if (length > 0 && !gone) {
+		int header = sprintf(msg, "{\"chunk\":%d}\n", (int)length);
+		if (writeall(client->fd, msg, header) || writeall(client->fd, client->chunk, length)) {
+		    /* nobody to send the html to, stop the job */
+		    kill(pid, SIGKILL);
+		    gone = 1;
+		}
+	    } else if (length == 0 || (length < 0 && errno != EINTR)) {
+		close(out[0]);
+		out[0] = -1;
+		open--;
+	    }
+	}
+	if (fds[1].fd >= 0 && fds[1].revents) {
+	    ssize_t length;
+	    /* past LOGSIZE the output is read and dropped */
+	    if (client->loglength < LOGSIZE)
+		length = read(err[0], client->log + client->loglength, LOGSIZE - client->loglength);
+	    else
+		length = read(err[0], msg, sizeof(msg));
+	    if (length > 0) {
+		if (client->loglength < LOGSIZE)
+		    client->loglength += length;
+	    } else if (length == 0 || (length < 0 && errno != EINTR)) {
+		close(err[0]);
+		err[0] = -1;
+		open--;
+	    }
+	}
+    }
+    if (out[0] >= 0)
+	close(out[0]);
+    if (err[0] >= 0)
+	close(err[0]);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	;
+    if (gone)
+	return -1;
+    if (timedout) {
+	sprintf(msg, "timed out after %d seconds", config->timeout);
+	error = msg;
+	status = 128 + SIGKILL;
+    } else if (WIFSIGNALED(status)) {
+	sprintf(msg, "killed by signal %d", WTERMSIG(status));
+	error = msg;
+	status = 128 + WTERMSIG(status);
+    } else
+	status = WEXITSTATUS(status);
+    return sendstatus(client, status, error);
+}
+
+ /*
+  * readline
+  *  read the next request line of the client into client->line. returns its
+  *  length, -1 at the end of the connection, or -2 if the line is longer
+  *  than MAXREQUEST
+  */
+static int readline(struct Client *client, int *start) {
+    char *newline;
+    /* drop the line returned last time */
+    if (*start) {
+	memmove(client->line, client->line + *start, client->length - *start);
+	client->length -= *start;
+	*start = 0;
+    }
+    for (;;) {
+	ssize_t count;
+	newline = memchr(client->line, '\n', client->length);
+	if (newline) {
+	    *start = newline - client->line + 1;
+	    return newline - client->line;
+	}
+	if (client->length == client->linesize) {
+	    if (client->linesize >= MAXREQUEST)
+		return -2;
+	    client->linesize *= 2;
+	    client->line = realloc(client->line, client->linesize);
+	}
+	count = read(client->fd, client->line + client->length, client->linesize - client->length);
+	if (count < 0 && errno == EINTR)
+	    continue;
+	if (count <= 0) {
+	    /* a last line without a newline */
+	    if (client->length) {
+		*start = client->length;
+		return client->length;
+	    }
+	    return -1;
+	}
+	client->length += count;
+    }
+}
+
+ /*
+  * serve
+  *  run the jobs of a connection, one per line, until it is closed
+  */
+static void serve(struct ServerConfig *config, struct Client *client) {
+    int start = 0, length;
+    client->length = 0;
+    while ((length = readline(client, &start)) != -1) {
+	struct ServerJob job;
+	char *error;
+	if (length == -2) {
+	    /* the rest of the line can not be told from the next request */
+	    client->loglength = 0;
+	    sprintf(client->chunk, "a request is at most %d bytes", MAXREQUEST);
+	    sendstatus(client, 2, client->chunk);
+	    break;
+	}
+	if (!length || (length == 1 && client->line[0] == '\r'))
+	    continue;
+	error = parsejob(client->line, client->line + length, &job);
+	client->loglength = 0;
+	if (error ? sendstatus(client, 2, error) : runjob(config, client, &job)) {
+	    job_free(&job);
+	    break;
+	}
+	job_free(&job);
+    }
+}
+
+ /*
+  * Listener
+  *  the listening socket shared by the worker threads
+  */
+struct Listener {
+    struct ServerConfig *config;
+    int fd;
+};
+
+ /*
+  * serverworker
+  *  thread proc, accepts connections and serves them, keeping its buffers
+  *  between connections
+  */
+static void *serverworker(void *context) {
+    struct Listener *listener = context;
+    struct Client client;
+    memset(&client, 0, sizeof(client));
+    client.linesize = 4096;
+    client.line = malloc(client.linesize);
+    client.chunk = malloc(CHUNKSIZE);
+    client.log = malloc(LOGSIZE);
+    for (;;) {
+	client.fd = accept(listener->fd, NULL, NULL);
+	if (client.fd < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    fprintf(stderr, "accept failed: %s\n", strerror(errno));
+	    break;
+	}
+	serve(listener->config, &client);
+	close(client.fd);
+    }
+    free(client.line);
+    free(client.chunk);
+    free(client.log);
+    return NULL;
+}
+
+ /*
+  * server_run
+  *  listen on config->path and serve jobs with config->workers threads
+  */
+int server_run(struct ServerConfig *config) {
+    struct Listener listener;
+    struct sockaddr_un addr;
+    struct stat st;
+    pthread_t *ids;
+    int i;
+
+    if (strlen(config->path) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "Socket path %s is too long.\n", config->path);
+	return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    listener.config = config;
+    listener.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener.fd < 0) {
+	fprintf(stderr, "Unable to create socket: %s\n", strerror(errno));
+	return 1;
+    }
+    /* a socket left behind by a server that is gone */
+    if (!stat(config->path, &st) && S_ISSOCK(st.st_mode))
+	unlink(config->path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, config->path);
+    if (bind(listener.fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener.fd, SOMAXCONN)) {
+	fprintf(stderr, "Unable to listen on %s: %s\n", config->path, strerror(errno));
+	close(listener.fd);
+	return 1;
+    }
+    ids = malloc(sizeof(pthread_t) * (config->workers + 1));
+    for (i = 1; i < config->workers; i++) {
+	if (pthread_create(&ids[i], NULL, serverworker, &listener))
+	    break;
+    }
+    serverworker(&listener);
+    close(listener.fd);
+    free(ids);
+    return 1;
+}
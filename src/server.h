@@ -0,0 +1,68 @@
+/*
+ * server.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_SERVER_H
+#define INCLUDED_SERVER_H
+#include <stdio.h>
+struct array;
+
+ /*
+  * ServerJob
+  *  a conversion request read from a client, one json object per line:
+  *    {"input": "/books/a.xml", "options": ["--ragright", "--top=39"]}
+  *    {"xml": "<?xml version=...", "options": ["--dontreflow=1-3"]}
+  *  a line is at most 64M, larger documents are sent by path. the options
+  *  of the server process, --diag, --manifest, --server, --timeout, --memlimit,
+  *  --workers, --help, --showdebug and --version, and input file names are
+  *  refused with status 5
+  */
+struct ServerJob {
+    char *input;		/* path of the input file, or NULL */
+    char *xml;			/* inline pdf2xml document, or NULL */
+    int xmllen;			/* length of xml */
+    struct array *options;	/* command line options for the job, strings */
+};
+
+ /*
+  * ServerConfig
+  *  how the server runs jobs
+  */
+struct ServerConfig {
+    char *path;			/* path of the unix domain socket */
+    int workers;		/* number of connections served at once */
+    int timeout;		/* seconds a job may run, 0 for no limit */
+    long memlimit;		/* megabytes of memory a job may use, 0 for no limit */
+    /* converts job, writing the html to out. returns the exit status */
+    int (*convert)(struct ServerJob *job, FILE *out);
+};
+
+ /*
+  * server_run
+  *  listen on config->path and serve jobs. each job runs in a child process
+  *  with the time and memory limits, its html is sent back in chunks:
+  *    {"chunk":N}\n followed by N bytes of html
+  *  and then its result:
+  *    {"status":S,"log":"...stderr of the job..."}\n
+  *  returns only on an error setting up the socket
+  */
+int server_run(struct ServerConfig *config);
+
+#endif /* INCLUDED_SERVER_H */
@@ -0,0 +1,136 @@
+/*
+ * sink.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "sink.h"
+
+ /*
+  * sink_init
+  *  set up an empty sink writing to write, which returns non zero on error
+  */
+void sink_init(struct Sink *sink, int (*write)(void *context, const char *data, size_t length), void *context) {
+    sink->write = write;
+    sink->context = context;
+    sink->failed = 0;
+    sink->length = 0;
+}
+
+ /*
+  * sink_flush
+  *  write what is buffered. returns 0, or -1 if a write failed
+  */
+int sink_flush(struct Sink *sink) {
+    if (sink->length && !sink->failed && sink->write(sink->context, sink->buf, sink->length))
+	sink->failed = 1;
+    sink->length = 0;
+    return sink->failed ? -1 : 0;
+}
+
+ /*
+  * sink_write
+  *  print length bytes of data. data larger than the buffer is written
+  *  as is after what is buffered
+  */
+void sink_write(struct Sink *sink, const char *data, size_t length) {
+    if (length > SINKSIZE - sink->length) {
+	sink_flush(sink);
+	if (length >= SINKSIZE) {
+	    if (!sink->failed && sink->write(sink->context, data, length))
+		sink->failed = 1;
+	    return;
+	}
+    }
+    memcpy(sink->buf + sink->length, data, length);
+    sink->length += length;
+}
+
+ /*
+  * sink_puts
+  *  print a NUL terminated string
+  */
+void sink_puts(struct Sink *sink, const char *str) {
+    sink_write(sink, str, strlen(str));
+}
+
+ /*
+  * sink_putc
+  *  print a character
+  */
+void sink_putc(struct Sink *sink, int c) {
+    if (sink->length == SINKSIZE)
+	sink_flush(sink);
+    sink->buf[sink->length++] = c;
+}
+
+ /*
+  * sink_putint
+  *  print val in decimal
+  */
+void sink_putint(struct Sink *sink, int val) {
+    char digits[12];
+    char *cur = digits + sizeof(digits);
+    unsigned int u = (val < 0) ? 0u - (unsigned int)val : (unsigned int)val;
+    do {
+	*--cur = '0' + (u % 10);
+	u /= 10;
+    } while (u);
+    if (val < 0)
+	*--cur = '-';
+    sink_write(sink, cur, digits + sizeof(digits) - cur);
+}
+
+ /*
+  * sink_printf
+  *  print like printf, for the debug reports. formats in place when it
+  *  fits in the buffer, output larger than the buffer is formatted in a
+  *  malloced one
+  */
+void sink_printf(struct Sink *sink, const char *format, ...) {
+    va_list args;
+    size_t room = SINKSIZE - sink->length;
+    char *buf;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(sink->buf + sink->length, room, format, args);
+    va_end(args);
+    if (length < 0)
+	return;
+    if ((size_t)length < room) {
+	sink->length += length;
+	return;
+    }
+    sink_flush(sink);
+    va_start(args, format);
+    if (length < SINKSIZE) {
+	sink->length = vsnprintf(sink->buf, SINKSIZE, format, args);
+    } else if ((buf = malloc(length + 1))) {
+	vsnprintf(buf, length + 1, format, args);
+	sink_write(sink, buf, length);
+	free(buf);
+    }
+    va_end(args);
+}
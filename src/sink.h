@@ -0,0 +1,85 @@
+/*
+ * sink.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCLUDED_SINK_H
+#define INCLUDED_SINK_H
+#include <stddef.h>
+
+#define SINKSIZE 65536		/* bytes buffered before a write */
+
+ /*
+  * Sink
+  *  the html output. everything printed is copied into buf, and handed to
+  *  write once buf is full, so a document is written in a few large pieces
+  *  and printing does not allocate
+  */
+struct Sink {
+    int (*write)(void *context, const char *data, size_t length);
+    void *context;
+    int failed;			/* write returned an error, the rest is dropped */
+    size_t length;		/* bytes in buf */
+    char buf[SINKSIZE];
+};
+
+ /*
+  * sink_init
+  *  set up an empty sink writing to write, which returns non zero on error
+  */
+void sink_init(struct Sink *sink, int (*write)(void *context, const char *data, size_t length), void *context);
+
+ /*
+  * sink_write
+  *  print length bytes of data
+  */
+void sink_write(struct Sink *sink, const char *data, size_t length);
+
+ /*
+  * sink_puts
+  *  print a NUL terminated string
+  */
+void sink_puts(struct Sink *sink, const char *str);
+
+ /*
+  * sink_putc
+  *  print a character
+  */
+void sink_putc(struct Sink *sink, int c);
+
+ /*
+  * sink_putint
+  *  print val in decimal
+  */
+void sink_putint(struct Sink *sink, int val);
+
+ /*
+  * sink_printf
+  *  print like printf, for the debug reports
+  */
+void sink_printf(struct Sink *sink, const char *format, ...);
+
+ /*
+  * sink_flush
+  *  write what is buffered. returns 0, or -1 if a write failed
+  */
+int sink_flush(struct Sink *sink);
+
+#endif /* INCLUDED_SINK_H */
@@ -0,0 +1,171 @@
+/*
+ * stats.c 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+static const char *phasenames[STATS_PHASES] = {
+    "parse", "sort", "analyze", "segment", "consolidate", "emit"
+};
+
+ /*
+  * seconds
+  *  returns the time of clock in seconds
+  */
+static double seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+ /*
+  * stats_threadcpu
+  *  returns the cpu seconds used by the calling thread
+  */
+double stats_threadcpu() {
+    return seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+ /*
+  * stats_init
+  *  clear stats, no phase is running
+  */
+void stats_init(struct Stats *stats) {
+    memset(stats, 0, sizeof(struct Stats));
+    stats->phase = -1;
+}
+
+ /*
+  * stats_end
+  *  end the running phase. stats may be NULL
+  */
+void stats_end(struct Stats *stats) {
+    if (!stats || stats->phase < 0)
+	return;
+    stats->wall[stats->phase] += seconds(CLOCK_MONOTONIC) - stats->startwall;
+    stats->cpu[stats->phase] += stats_threadcpu() - stats->startcpu;
+    stats->phase = -1;
+}
+
+ /*
+  * stats_begin
+  *  end the running phase, and start timing phase. stats may be NULL
+  */
+void stats_begin(struct Stats *stats, enum stats_phase phase) {
+    if (!stats)
+	return;
+    stats_end(stats);
+    stats->phase = phase;
+    stats->startwall = seconds(CLOCK_MONOTONIC);
+    stats->startcpu = stats_threadcpu();
+}
+
+ /*
+  * stats_addcpu
+  *  add the cpu seconds of another thread to the running phase
+  */
+void stats_addcpu(struct Stats *stats, double cpu) {
+    if (stats && stats->phase >= 0)
+	stats->cpu[stats->phase] += cpu;
+}
+
+ /*
+  * peakrss
+  *  returns the peak resident set size of the process in bytes
+  */
+static long peakrss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+	return 0;
+    return usage.ru_maxrss * 1024L;
+}
+
+ /*
+  * putjson
+  *  print str to file as a json string
+  */
+static void putjson(FILE *file, const char *str) {
+    putc('"', file);
+    for (; *str; str++) {
+	unsigned char c = *str;
+	if (c == '"' || c == '\\')
+	    fprintf(file, "\\%c", c);
+	else if (c < 0x20)
+	    fprintf(file, "\\u%04x", c);
+	else
+	    putc(c, file);
+    }
+    putc('"', file);
+}
+
+ /*
+  * stats_print
+  *  print stats of the input name (or NULL) to file, as text, or as a json
+  *  object on one line. the peak rss is that of the process
+  */
+void stats_print(struct Stats *stats, const char *name, FILE *file, int json) {
+    double wall = 0, cpu = 0, mbps = 0;
+    double mb = stats->bytes / 1e6;
+    long rss = peakrss();
+    int i;
+
+    for (i = 0; i < STATS_PHASES; i++) {
+	wall += stats->wall[i];
+	cpu += stats->cpu[i];
+    }
+    if (wall > 0)
+	mbps = mb / wall;
+    /* the reports of files converted at once are not mixed */
+    flockfile(file);
+    if (json) {
+	fprintf(file, "{\"input\":");
+	if (name)
+	    putjson(file, name);
+	else
+	    fprintf(file, "null");
+	fprintf(file, ",\"phases\":{");
+	for (i = 0; i < STATS_PHASES; i++)
+	    fprintf(file, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i ? "," : "",
+		phasenames[i], stats->wall[i], stats->cpu[i]);
+	fprintf(file, "},\"wall\":%.6f,\"cpu\":%.6f,\"pages\":%d,\"texts\":%d,"
+	    "\"lines\":%d,\"paragraphs\":%d,\"bytes\":%lu,\"mbps\":%.3f,\"peakrss\":%ld}\n",
+	    wall, cpu, stats->pages, stats->texts, stats->lines, stats->paras,
+	    (unsigned long)stats->bytes, mbps, rss);
+    } else {
+	if (name)
+	    fprintf(file, "Stats for %s:\n", name);
+	else
+	    fprintf(file, "Stats:\n");
+	fprintf(file, "  %-12s %10s %10s\n", "phase", "wall ms", "cpu ms");
+	for (i = 0; i < STATS_PHASES; i++)
+	    fprintf(file, "  %-12s %10.3f %10.3f\n", phasenames[i], stats->wall[i] * 1000, stats->cpu[i] * 1000);
+	fprintf(file, "  %-12s %10.3f %10.3f\n", "total", wall * 1000, cpu * 1000);
+	fprintf(file, "  %d pages, %d texts, %d lines, %d paragraphs\n", stats->pages, stats->texts, stats->lines, stats->paras);
+	fprintf(file, "  input %.2f MB, %.2f MB/s, peak rss %.1f MB\n", mb, mbps, rss / 1e6);
+    }
+    funlockfile(file);
+}
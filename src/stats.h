@@ -0,0 +1,98 @@
+/*
+ * stats.h 
+ *
+ * Copyright (C) 2010 Pranananda Deva 
+ *
+ * This file is part of pdfreflow.
+ * 
+ * Pdfreflow is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Pdfreflow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pdfreflow.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCLUDED_STATS_H
+#define INCLUDED_STATS_H
+#include <stdio.h>
+#include <stddef.h>
+
+ /*
+  * stats_phase
+  *  the phases of a conversion that are timed
+  */
+enum stats_phase {
+    STATS_PARSE,		/* parse_pdf2xml */
+    STATS_SORT,			/* page_sort, removing empties and page numbers */
+    STATS_ANALYZE,		/* the frequency analysis of the layout */
+    STATS_SEGMENT,		/* page_initpara and page_printpara per page */
+    STATS_CONSOLIDATE,		/* paragraphs found across the pages */
+    STATS_EMIT,			/* styles and html printed */
+    STATS_PHASES
+};
+
+ /*
+  * Stats
+  *  wall and cpu seconds of each phase, and the size of the document.
+  *  cpu time is that of the converting thread, and of the threads parsing
+  *  pages for it.
+  */
+struct Stats {
+    double wall[STATS_PHASES];
+    double cpu[STATS_PHASES];
+    int phase;			/* running phase, -1 if none */
+    double startwall;		/* when the running phase started */
+    double startcpu;
+    size_t bytes;		/* size of the input */
+    int pages;			/* pages converted */
+    int texts;			/* text objects of those pages */
+    int lines;			/* lines of those pages */
+    int paras;			/* paragraphs found */
+};
+
+ /*
+  * stats_init
+  *  clear stats, no phase is running
+  */
+void stats_init(struct Stats *stats);
+
+ /*
+  * stats_begin
+  *  end the running phase, and start timing phase. stats may be NULL
+  */
+void stats_begin(struct Stats *stats, enum stats_phase phase);
+
+ /*
+  * stats_end
+  *  end the running phase. stats may be NULL
+  */
+void stats_end(struct Stats *stats);
+
+ /*
+  * stats_threadcpu
+  *  returns the cpu seconds used by the calling thread
+  */
+double stats_threadcpu();
+
+ /*
+  * stats_addcpu
+  *  add the cpu seconds of another thread to the running phase
+  */
+void stats_addcpu(struct Stats *stats, double cpu);
+
+ /*
+  * stats_print
+  *  print stats of the input name (or NULL) to file, as text, or as a json
+  *  object on one line. the peak rss is that of the process
+  */
+void stats_print(struct Stats *stats, const char *name, FILE *file, int json);
+
+#endif /* INCLUDED_STATS_H */
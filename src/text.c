@@ -24,6 +24,7 @@
 #include "text.h"
 #include "font.h"
 #include "array.h"
+#include "sink.h"
 #include <ctype.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,38 +33,58 @@
 struct Text {
     struct Rect r;  	/* bounding rect of text */
     int baseline;	/* baseline of this text */
-    struct Atom *font;	/* atom that refers to font id */
-    char *buf;		/* contents of text tag        */
-    char *other;	/* pointer to new text if buf had part of a hyphenated string */
+    int fontsize;	/* size of the font, -1 if the font is not known */
+    int bottom;		/* top + fontsize, the bottom used to intersect lines */
+    int font;		/* index of the font in font.h */
+    char *buf;		/* contents of text tag, points into the input  */
+    int length;		/* length of buf, shortened if buf starts with the end of a hyphenated word */
+    int size;		/* length of the whole contents of the text tag */
+    int other;		/* offset of the rest of buf, if buf had part of a hyphenated string, else -1 */
+    int hyphen;		/* offset of an end of line hyphen that is not printed, else -1 */
+    int hyphenlen;	/* number of chars not printed at hyphen */
 };
 
  /*
   * text_init
-  *  creates a new text object, calcs baseline
+  *  creates a new text object, calcs baseline. fontsize is the size of the font
+  *  when the text is read, -1 if not known. buf is not copied.
   */
-struct Text *text_init(int top, int left, int width, int height, struct Atom *font, char *buf) {
+struct Text *text_init(int top, int left, int width, int height, int font, int fontsize, char *buf, int length) {
     struct Text *text = calloc(1, sizeof(struct Text));
     if (text) {
-	int size;
 	text->r.top = top;
 	text->r.left = left;
 	text->r.width = width;
 	text->r.height = height;
 	text->font = font;
-	text->buf = strdup(buf);
-	size = font_size(font);
-	text->baseline =  (size > 0)  ? (top + size) : top;
+	text->buf = buf ? buf : "";
+	text->length = buf ? length : 0;
+	text->size = text->length;
+	text->other = -1;
+	text->hyphen = -1;
+	text->fontsize = fontsize;
+	text->bottom = top + fontsize;
+	text->baseline =  (fontsize > 0)  ? (top + fontsize) : top;
     }
     return text;
 }
 
 
+ /*
+  * text_updatefont
+  *  reads the font size again, after the font has been added or replaced.
+  *  The baseline stays as it was when the text was read.
+  */
+void text_updatefont(struct Doc *doc, struct Text *text) {
+    text->fontsize = font_size(doc, text->font);
+    text->bottom = text->r.top + text->fontsize;
+}
+
  /*
   * text_free
   *  frees text object
   */
 void text_free(struct Text *text) {
-    free(text->buf);
     free(text);
 }
 
@@ -73,12 +94,13 @@ void text_free(struct Text *text) {
   *  returns 1 if text buf is only whitespace
   */
 int text_isempty(struct Text *text) {
-    unsigned char *cur;
-    for (cur = (unsigned char *)text->buf; *cur; cur++) {
+    unsigned char *cur = (unsigned char *)text->buf;
+    unsigned char *end = cur + text->length;
+    for (; cur < end; cur++) {
 	if (!isspace(*cur)) {
 	    if (*cur == '<') {
-		for (cur++; *cur && *cur != '>' ; cur++);
-		if (!cur)
+		for (cur++; cur < end && *cur != '>' ; cur++);
+		if (cur == end)
 		    return 1;
 		continue;
 	    }
@@ -95,23 +117,25 @@ int text_isempty(struct Text *text) {
   *  -1 is returned
   */
 int text_numericvalue(struct Text *text) {
-    unsigned char *cur;
-    for (cur = (unsigned char *)text->buf; *cur; cur++) {
+    unsigned char *cur = (unsigned char *)text->buf;
+    unsigned char *last = cur + text->length;
+    for (; cur < last; cur++) {
 	if (!isspace(*cur))
 	    break;
     }
-    if (!*cur)
+    if (cur == last)
 	return -1;
     if (*cur > '0' && *cur <= '9') {
-	char *end;
-	int val = strtol((char *)cur, &end, 10);
-	if (!*end || (*end == ' ') || (*end == '<'))
+	int val = 0;
+	for (; cur < last && isdigit(*cur); cur++)
+	    val = (val * 10) + (*cur - '0');
+	if (cur == last || (*cur == ' ') || (*cur == '<'))
 	    return val;
-	for (cur = (unsigned char *)end; *cur; cur++) {
+	for (; cur < last; cur++) {
 	    if (!isspace(*cur))
 		break;
 	}
-	return (*cur) ? -1 : val;
+	return (cur < last) ? -1 : val;
     }
     return -1;
 }
@@ -121,7 +145,7 @@ int text_numericvalue(struct Text *text) {
   *  returns the length of the contained text
   */
 int text_length(struct Text *text) {
-    return text->buf ? strlen(text->buf) : 0;
+    return text->length;
 }
 
  /*
@@ -185,7 +209,7 @@ int text_leading(struct Text *text,  struct Text *other) {
   * text_font
   *  returns the font of the contained text
   */
-struct Atom *text_font(struct Text *text) {
+int text_font(struct Text *text) {
     return text->font;
 }
 
@@ -193,8 +217,8 @@ struct Atom *text_font(struct Text *text) {
   * text_fontprintstr
   *  returns a print string with font-fontsize, ie Times-10
   */
-struct Atom *text_fontprintstr(struct Text *text) {
-    return font_printstr(text->font);
+struct Atom *text_fontprintstr(struct Doc *doc, struct Text *text) {
+    return font_printstr(doc, text->font);
 }
 
 
@@ -203,7 +227,7 @@ struct Atom *text_fontprintstr(struct Text *text) {
   *  returns the font of the contained text
   */
 int text_fontsize(struct Text *text) {
-    return font_size(text->font);
+    return text->fontsize;
 }
 
  /*
@@ -211,12 +235,9 @@ int text_fontsize(struct Text *text) {
   *  returns 1 if the bounding rects intersect vertically, 0 otherwise
   */
 static int intersectsY(struct Text *text, struct Text *other) {
-    int mybot = text->r.top + text_fontsize(text);
-    int otherbot = other->r.top + text_fontsize(other);
-    
-    if (mybot <= other->r.top)
+    if (text->bottom <= other->r.top)
 	return 0;
-    if (text->r.top >= otherbot)
+    if (text->r.top >= other->bottom)
 	return 0;
     return 1;
 }
@@ -236,51 +257,6 @@ int text_intersects(struct Text *text, struct Text *other) {
     return (intersectsY(text, other) && !rect_intersects(text->r, other->r));
 }
 
- /*
-  * text_compare
-  *  called by qsort to compare text objects, top to bottom, left to right
-  */
-int text_compare(struct Text *text, struct Text *other) {
-    if (text_intersects(text, other)) {
-	if (text->r.left < other->r.left)
-	    return -1;
-	if (text->r.left > other->r.left)
-	    return 1;
-	return 0;
-    }
-    
-    if (text->r.top < other->r.top)
-	return -1;
-    if (text->r.top > other->r.top)
-	return 1;
-    if (text->r.left < other->r.left)
-	return -1;
-    if (text->r.left > other->r.left)
-	return 1;
-    return 0;
-}
- /*
-  * text_compare
-  *  returns -1 if this is before other in page
-  *  return 1 if this is after other in page
-  *  return 0 if the same position
-  *  order is first top to bottom, and then for texts on the same line,
-  *  left to right.
-  */
- /*
-int text_compare(struct Text *text, struct Text *other) {
-    if (text->r.top < other->r.top)
-	return -1;
-    if (text->r.top > other->r.top)
-	return 1;
-    if (text->r.left < other->r.left)
-	return -1;
-    if (text->r.left > other->r.left)
-	return 1;
-    return 0;
-}
-  */
-
  /*
   * text_rect
   *  returns the rect of the contained text
@@ -295,9 +271,8 @@ struct Rect text_rect(struct Text *text) {
   */
 struct Rect text_bounds(struct Text *text) {
     struct Rect r = text->r;
-    int size = font_size(text->font);
-    if (size > r.height)
-	r.height = size;
+    if (text->fontsize > r.height)
+	r.height = text->fontsize;
     return r;
 }
 
@@ -305,33 +280,31 @@ struct Rect text_bounds(struct Text *text) {
   * text_print
   *  print the contents of text
   */
-void text_print(struct Text *text) {
-    fprintf(stderr, "<text top=\"%d\" left=\"%d\" width=\"%d\" height=\"%d\" font=\"%d\">%s</text>\n", text->r.top, text->r.left, text->r.width, text->r.height, font_size(text->font), text->buf);
-}
-
-static char *quo = "&quot;";
-int quolen = 0;
-static char *ldquo = "&ldquo;";
-int ldquolen = 0;
-static char *rdquo = "&rdquo;";
-int rdquolen = 0;
-static char *luquo = "“";
-int luquolen = 0;
-static char *ruquo = "”";
-int ruquolen = 0;
-static char *d1 = "–";
-int d1len = 0;
-static char *d2 = "—";
-int d2len = 0;
-
-static void initquotes() {
-    quolen = strlen(quo);
-    ldquolen = strlen(ldquo);
-    rdquolen = strlen(rdquo);
-    luquolen = strlen(luquo);
-    ruquolen = strlen(ruquo);
-    d1len = strlen(d1);
-    d2len = strlen(d2);
+void text_print(struct Text *text, struct Sink *sink) {
+    sink_printf(sink, "<text top=\"%d\" left=\"%d\" width=\"%d\" height=\"%d\" font=\"%d\">%.*s</text>\n", text->r.top, text->r.left, text->r.width, text->r.height, text->fontsize, text->length, text->buf);
+}
+
+static char quo[] = "&quot;";
+#define quolen ((int)sizeof(quo) - 1)
+static char ldquo[] = "&ldquo;";
+#define ldquolen ((int)sizeof(ldquo) - 1)
+static char rdquo[] = "&rdquo;";
+#define rdquolen ((int)sizeof(rdquo) - 1)
+static char luquo[] = "“";
+#define luquolen ((int)sizeof(luquo) - 1)
+static char ruquo[] = "”";
+#define ruquolen ((int)sizeof(ruquo) - 1)
+static char d1[] = "–";
+#define d1len ((int)sizeof(d1) - 1)
+static char d2[] = "—";
+#define d2len ((int)sizeof(d2) - 1)
+
+ /*
+  * matchstr
+  *  returns 1 if str is at position i in buf
+  */
+static int matchstr(struct Text *text, int i, char *str, int length) {
+    return (i >= 0 && (i + length) <= text->length && !memcmp(text->buf + i, str, length));
 }
 
  /*
@@ -339,10 +312,8 @@ static void initquotes() {
   *  returns 1 if text start with a capital letter or a digit
   */
 int text_startswithquote(struct Text *text) {
-    int i, length = strlen(text->buf);
+    int i, length = text->length;
     unsigned char ch;
-    if (!quolen) 
-	initquotes();
     for (i = 0; i < length; i++) {
 	ch = (unsigned char)text->buf[i];
 	if (ch == '<') {
@@ -353,7 +324,7 @@ int text_startswithquote(struct Text *text) {
 	}
 	if (islower(ch) || isspace(ch))
 	    return 0;
-	if (ch == '"' || !strncmp(text->buf + i, quo, quolen) || !strncmp(text->buf + i, ldquo, ldquolen) || !strncmp(text->buf + i, luquo, luquolen) )
+	if (ch == '"' || matchstr(text, i, quo, quolen) || matchstr(text, i, ldquo, ldquolen) || matchstr(text, i, luquo, luquolen) )
 	    return 1;
 	return 0;
     }
@@ -364,10 +335,8 @@ int text_startswithquote(struct Text *text) {
   *  returns 1 if text start with a capital letter or a digit
   */
 int text_startswithcap(struct Text *text) {
-    int i, length = strlen(text->buf);
+    int i, length = text->length;
     unsigned char ch;
-    if (!quolen) 
-	initquotes();
     for (i = 0; i < length; i++) {
 	ch = (unsigned char)text->buf[i];
 	if (ch == '<') {
@@ -378,7 +347,7 @@ int text_startswithcap(struct Text *text) {
 	}
 	if (islower(ch) || isspace(ch))
 	    return 0;
-	if (isupper(ch) || isdigit(ch) || ch == '"' || !strncmp(text->buf + i, quo, quolen) || !strncmp(text->buf + i, ldquo, ldquolen) || !strncmp(text->buf + i, luquo, luquolen) )
+	if (isupper(ch) || isdigit(ch) || ch == '"' || matchstr(text, i, quo, quolen) || matchstr(text, i, ldquo, ldquolen) || matchstr(text, i, luquo, luquolen) )
 	    return 1;
 	return 0;
     }
@@ -390,11 +359,9 @@ int text_startswithcap(struct Text *text) {
   *  returns 1 if text ends in punctuation (.!?) character
   */
 int text_endsinpunc(struct Text *text) {
-    int length = strlen(text->buf);
+    int length = text->length;
     int i;
     unsigned char ch;
-    if (!quolen) 
-	initquotes();
     for (i = length - 1; i >= 0; i--) {
 	ch = (unsigned char)text->buf[i];
 	if (ch == '.' || ch == '?' || ch == '!' || ch == ':')
@@ -458,13 +425,14 @@ int text_endsinpunc(struct Text *text) {
   *  returns 1 if text ends in punctuation (.!?) character
   */
 static char *text_endsinhyphen(struct Text *text) {
-    int length;
+    int start, length;
     int i;
     unsigned char ch;
     char *buf, *tag;
     
-    buf = (text->other) ? text->other : text->buf;
-    length = strlen(buf);
+    start = (text->other >= 0) ? text->other : 0;
+    buf = text->buf + start;
+    length = ((text->other >= 0) ? text->size : text->length) - start;
     for (i = length - 1; i >= 0; i--) {
 	ch = (unsigned char)buf[i];
 	if (ch == '-') {
@@ -473,11 +441,9 @@ static char *text_endsinhyphen(struct Text *text) {
 	    ch = buf[i - 1];
 	    if (!isalpha(ch) || isupper(ch))
 		return NULL;
-	    tag = strchr(buf + i, '<');
-	    if (tag)
-		memmove(buf+i, tag, strlen(tag) + 1);
-	    else
-		buf[i] = 0;
+	    tag = memchr(buf + i, '<', length - i);
+	    text->hyphen = start + i;
+	    text->hyphenlen = (tag ? (tag - buf) : length) - i;
 	    return buf + i;
 	}
 	if (isspace(ch))
@@ -551,14 +517,14 @@ static char *skipfirsttag(char *buf) {
   */
 static char *text_hyphencont(struct Text *text) {
     char *space;
-    if (text->other)
+    if (text->other >= 0)
 	return skipfirsttag(text->buf);
-    space = strchr(text->buf, ' ');
+    space = memchr(text->buf, ' ', text->length);
     if (space) {
-	*space = 0;
-	text->other = space + 1;
+	text->length = space - text->buf;
+	text->other = text->length + 1;
     } else {
-	text->other = text->buf + strlen(text->buf);
+	text->other = text->length;
     }
     return skipfirsttag(text->buf);
 }
@@ -568,14 +534,35 @@ static char *text_hyphencont(struct Text *text) {
   *  prints the contents of the str, but also looks for leading spaces to be replace with 
   *  non-blocking spaces -- some PDFs do indentation this way, a bit of a hack.
   */
-static int printstr(FILE *file, char *str, int isparastart) {
+static void printstr(struct Sink *sink, char *str, int length, int isparastart) {
     if (isparastart) {
-	while (*str == ' ') {
-	    fprintf(file, "&nbsp;");
+	while (length > 0 && *str == ' ') {
+	    sink_write(sink, "&nbsp;", 6);
 	    str++;
+	    length--;
 	}
     }
-    return fprintf(file, "%s", str);
+    sink_write(sink, str, length);
+}
+
+ /*
+  * printbuf
+  *  prints the part of the text not already printed with the previous line,
+  *  leaving out an end of line hyphen
+  */
+static void printbuf(struct Sink *sink, struct Text *text, int isparastart) {
+    int start = 0, end = text->length, rest;
+    if (text->other >= 0) {
+	start = text->other;
+	end = text->size;
+    }
+    if (text->hyphen < start) {
+	printstr(sink, text->buf + start, end - start, isparastart);
+	return;
+    }
+    printstr(sink, text->buf + start, text->hyphen - start, isparastart);
+    rest = text->hyphen + text->hyphenlen;
+    sink_write(sink, text->buf + rest, end - rest);
 }
 
 
@@ -583,26 +570,26 @@ static int printstr(FILE *file, char *str, int isparastart) {
   * text_printtext
   *  prints contents of text object, taking into account hyphenation.
   */
-int text_printtext(struct Text *text, struct Text *next, int isparastart, FILE *outfile) {
+void text_printtext(struct Text *text, struct Text *next, int isparastart, struct Sink *sink) {
     char *hyphen = text_endsinhyphen(text);
+    printbuf(sink, text, isparastart);
     if (hyphen && next && !text_startswithcap(next)) {
-	printstr(outfile, text->other ? text->other: text->buf, isparastart);
-	return fprintf(outfile, "%s", text_hyphencont(next));
+	char *cont = text_hyphencont(next);
+	sink_write(sink, cont, next->length - (cont - next->buf));
     }
-    return printstr(outfile, text->other ? text->other: text->buf, isparastart);
 }
 
 
  /*
   * text_printcontents
-  *  prints the contents of text objects into files
+  *  prints the contents of text objects, followed by a newline
   */
-void text_printcontents(struct array *texts, FILE *file, int start, int last) {
+void text_printcontents(struct array *texts, struct Sink *sink, int start, int last) {
     int i;
     for (i = start; i < last; i++) {
 	struct Text *text = array_elementat(texts, i);
-	fprintf(file, "%s", text->buf);
+	sink_write(sink, text->buf, text->length);
     }
-    fprintf(file, "\n");
+    sink_putc(sink, '\n');
 }
 
@@ -23,12 +23,24 @@
 #define INCLUDED_TEXT_H
 struct Text;
 struct Atom;
+struct Doc;
 
 #include "rect.h"
 #include <stdio.h>
 
-struct Text *text_init(int top, int left, int width, int height, struct Atom *font, char *buf);
+ /*
+  * text_init
+  *  creates a new text object. fontsize is the size of the font when the
+  *  text is read, -1 if not known. buf is not copied, it must live as long
+  *  as the text object, and is length chars long.
+  */
+struct Text *text_init(int top, int left, int width, int height, int font, int fontsize, char *buf, int length);
 void text_free(struct Text *text);
+ /*
+  * text_updatefont
+  *  reads the font size again, after the font has been added or replaced
+  */
+void text_updatefont(struct Doc *doc, struct Text *text);
 
  /*
   * text_isempty
@@ -98,10 +110,10 @@ int text_leading(struct Text *text,  struct Text *other);
 int text_top(struct Text *text);
  /*
   * text_font
-  *  returns the font of the contained text
+  *  returns the font index (font.h) of the contained text
   */
-struct Atom *text_font(struct Text *text);
-struct Atom *text_fontprintstr(struct Text *text);
+int text_font(struct Text *text);
+struct Atom *text_fontprintstr(struct Doc *doc, struct Text *text);
  /*
   * text_fontsize
   *  returns the font of the contained text
@@ -114,21 +126,13 @@ int text_fontsize(struct Text *text);
   */
 int text_intersects(struct Text *text, struct Text *other);
 
- /*
-  * text_compare
-  *  returns -1 if this is before other in page
-  *  return 1 if this is after other in page
-  *  return 0 if the same position
-  *  order is first top to bottom, and then for texts on the same line,
-  *  left to right.
-  */
-int text_compare(struct Text *text, struct Text *other);
+struct Sink;
 
  /*
   * text_print
   *  print the contents of text
   */
-void text_print(struct Text *text);
+void text_print(struct Text *text, struct Sink *sink);
 
  /*
   * text_endsinpunc
@@ -148,14 +152,18 @@ int text_startswithquote(struct Text *text);
   */
 int text_startswithcap(struct Text *text);
 
-int text_printtext(struct Text *text, struct Text *next, int isparastart, FILE *outfile);
+ /*
+  * text_printtext
+  *  prints contents of text object, taking into account hyphenation.
+  */
+void text_printtext(struct Text *text, struct Text *next, int isparastart, struct Sink *sink);
 
 struct array;
 
  /*
   * text_printcontents
-  *  prints the contents of text objects into files
+  *  prints the contents of text objects, followed by a newline
   */
-void text_printcontents(struct array *texts, FILE *file, int start, int last);
+void text_printcontents(struct array *texts, struct Sink *sink, int start, int last);
 
 #endif /* INCLUDED_TEXT_H */
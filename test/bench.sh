@@ -0,0 +1,188 @@
+#!/bin/sh
+
+# Times pdfreflow over test0.xml - test10.xml with the options of doit.sh,
+# and writes a json report, one line per test:
+#   {"test":"test3","options":"...","runs":5,"wall":0.0123,"minwall":0.0119,
+#    "phases":{"parse":...},"bytes":...,"pages":...,"mbps":...,"pagesps":...,
+#    "peakrss":...}
+# wall and the phases are the median over the runs, in seconds, as measured
+# by --stats. peakrss is the largest over the runs, in bytes.
+#
+# With --baseline the report is compared to an older one, and a test whose
+# median wall time grew by more than the threshold percent, and by more than
+# a millisecond, is a regression. The exit status is 1 if there is one.
+#
+# make bench runs this with $(BENCHFLAGS), i.e.
+#   make bench BENCHFLAGS="--runs=10 --baseline=bench-0.8.6.json"
+
+usage() {
+	echo "usage: bench.sh [--runs=N] [--output=FILE] [--baseline=FILE] [--threshold=PERCENT] pdfreflow"
+	exit 1
+}
+
+RUNS=5
+OUTPUT=bench.json
+BASELINE=
+THRESHOLD=10
+PDFREFLOW=
+
+for arg ; do
+	case $arg in
+	--runs=*)	RUNS=${arg#--runs=} ;;
+	--output=*)	OUTPUT=${arg#--output=} ;;
+	--baseline=*)	BASELINE=${arg#--baseline=} ;;
+	--threshold=*)	THRESHOLD=${arg#--threshold=} ;;
+	-*)		usage ;;
+	*)		PDFREFLOW=$arg ;;
+	esac
+done
+
+if [ -z "$PDFREFLOW" ] || [ "$RUNS" -lt 1 ] 2>/dev/null ; then
+	usage
+fi
+case $PDFREFLOW in
+	/*) ;;
+	*) PDFREFLOW=`pwd`/$PDFREFLOW ;;
+esac
+if [ ! -x "$PDFREFLOW" ] ; then
+	echo "bench.sh: $PDFREFLOW is not executable"
+	exit 1
+fi
+
+# TESTCOUNT and the option sets are those of doit.sh, which adds --showpara
+TESTCOUNT=11
+initarray() {
+    args0="--pageno"
+    args3="--dontreflow='3-8,12' --center=1:2 --nonfiction"
+    args4="--ragright"
+    args5="--top=39 --bottom=745 --dontreflow=4 --ragright"
+    args6="--ragright"
+    args7="--dontreflow=1-3 --ragright  --center=3:2"
+    args8="--ragright"
+    args9="--dontreflow='1-5,217-222' --nonfiction"
+}
+
+TESTDIR=`dirname $0`
+TMP=${TMPDIR:-/tmp}/bench.$$
+trap 'rm -f $TMP.*' 0
+trap 'exit 1' 1 2 15
+
+initarray
+: > $TMP.report
+CURTEST=0
+while [ $CURTEST -lt $TESTCOUNT ] ; do
+    eval ARGS="\$args${CURTEST}"
+    echo "Test ${CURTEST} pdfreflow --showpara ${ARGS} < test${CURTEST}.xml"
+    : > $TMP.runs
+    RUN=0
+    while [ $RUN -lt $RUNS ] ; do
+	# the input is read from standard in, so no html is left next to it
+	eval \"\$PDFREFLOW\" --showpara --diag=/dev/null --stats=json $ARGS \
+	    < $TESTDIR/test${CURTEST}.xml > /dev/null 2> $TMP.err
+	if ! grep '^{"input"' $TMP.err >> $TMP.runs ; then
+	    echo "Test ${CURTEST} failed"
+	    cat $TMP.err
+	    exit 1
+	fi
+	RUN=`expr $RUN + 1`
+    done
+    awk -v test="test${CURTEST}" -v options="--showpara ${ARGS}" -f - $TMP.runs >> $TMP.report <<'EOF'
+# the value of key, a number, in a --stats=json line
+function value(line, key) {
+    if (!match(line, "\"" key "\":[-0-9.e+]+"))
+	return 0
+    return substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3) + 0
+}
+# the median of the n values in v
+function median(v, n,    i, j, t) {
+    for (i = 2; i <= n; i++)
+	for (j = i; j > 1 && v[j - 1] > v[j]; j--) {
+	    t = v[j]; v[j] = v[j - 1]; v[j - 1] = t
+	}
+    return (n % 2) ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+}
+BEGIN {
+    nphases = split("parse sort analyze segment consolidate emit", phases, " ")
+}
+{
+    n++
+    # the total wall time follows the phases object
+    rest = substr($0, index($0, "}}") + 2)
+    wall[n] = value(rest, "wall")
+    for (p = 1; p <= nphases; p++) {
+	phase[p, n] = value(substr($0, index($0, "\"" phases[p] "\":")), "wall")
+    }
+    bytes = value($0, "bytes")
+    pages = value($0, "pages")
+    rss = value($0, "peakrss")
+    if (rss > peakrss)
+	peakrss = rss
+}
+END {
+    for (i = 1; i <= n; i++)
+	w[i] = wall[i]
+    med = median(w, n)
+    min = w[1]
+    out = sprintf("\"phases\":{")
+    for (p = 1; p <= nphases; p++) {
+	for (i = 1; i <= n; i++)
+	    w[i] = phase[p, i]
+	out = out sprintf("%s\"%s\":%.6f", (p > 1) ? "," : "", phases[p], median(w, n))
+    }
+    out = out "}"
+    gsub(/"/, "\\\"", options)
+    printf("{\"test\":\"%s\",\"options\":\"%s\",\"runs\":%d,\"wall\":%.6f,\"minwall\":%.6f,%s,\"bytes\":%d,\"pages\":%d,\"mbps\":%.3f,\"pagesps\":%.1f,\"peakrss\":%d}\n",
+	test, options, n, med, min, out, bytes, pages,
+	med > 0 ? bytes / med / 1e6 : 0, med > 0 ? pages / med : 0, peakrss)
+}
+EOF
+    CURTEST=`expr $CURTEST + 1`
+done
+
+mv $TMP.report $OUTPUT
+echo "Report written to $OUTPUT"
+if [ -z "$BASELINE" ] ; then
+    exit 0
+fi
+
+# compare the median wall time of each test to the baseline
+awk -v threshold="$THRESHOLD" -f - $BASELINE $OUTPUT <<'EOF'
+function value(line, key) {
+    if (!match(line, "\"" key "\":[-0-9.e+]+"))
+	return 0
+    return substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3) + 0
+}
+function name(line) {
+    match(line, "\"test\":\"[^\"]*\"")
+    return substr(line, RSTART + 8, RLENGTH - 9)
+}
+FNR == NR {
+    base[name($0)] = value($0, "wall")
+    next
+}
+{
+    test = name($0)
+    wall = value($0, "wall")
+    if (!(test in base)) {
+	printf("%-8s %10.3f ms  not in baseline\n", test, wall * 1000)
+	next
+    }
+    change = base[test] > 0 ? (wall - base[test]) * 100 / base[test] : 0
+    slower = change > threshold && wall - base[test] > 0.001
+    printf("%-8s %10.3f ms  baseline %10.3f ms  %+6.1f%%%s\n", test, wall * 1000,
+	base[test] * 1000, change, slower ? "  REGRESSION" : "")
+    if (slower)
+	regressions++
+    total += wall
+    basetotal += base[test]
+}
+END {
+    if (basetotal > 0)
+	printf("total    %10.3f ms  baseline %10.3f ms  %+6.1f%%\n", total * 1000,
+	    basetotal * 1000, (total - basetotal) * 100 / basetotal)
+    if (regressions) {
+	printf("%d tests slower than the baseline by more than %s%%\n", regressions, threshold)
+	exit 1
+    }
+}
+EOF
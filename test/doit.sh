@@ -57,4 +57,20 @@ while [ $CURTEST -lt $TESTCOUNT ] ; do
     CURTEST=`expr $CURTEST + 1`
 done
 
+# the css of test2, which has a text with an undefined font. its size
+# once came from a read before mods[] in html.c, and differed with -O2
+echo Test styles2 the css of test2.html
+sed -n '/<style/,/<\/style>/p' test2.html > outstyles2.txt
+if diff -qw outstyles2.txt styles2.txt ; then
+    echo "Test styles2 succeeded"
+else
+    echo "Test styles2 failed"
+    diff -w styles2.txt outstyles2.txt
+fi
+
+# the server tests, they need perl for the client
+if perl -MIO::Socket::UNIX -e 1 2>/dev/null ; then
+    sh server.sh pdfreflow
+fi
+
 #pdfreflow --pageno < test1.xml 2>out1.txt
@@ -0,0 +1,138 @@
+#!/bin/sh
+
+# Tests pdfreflow --server, using perl for the client. doit.sh runs it
+# after the conversion tests.
+#
+# Test concurrent: connection B is accepted, then connection A starts a
+# job that stays running, reading a fifo. B then runs a one page job and
+# closes its side. B must see the end of the connection as soon as its own
+# job is done, not when A's job exits.
+# Test options: options of the server process and input file names are
+# refused in a job with status 5, and --diag writes no file.
+# Test requestsize: a request line over 64M is answered with status 2.
+
+usage() {
+	echo "usage: server.sh pdfreflow"
+	exit 1
+}
+
+[ $# -eq 1 ] || usage
+PDFREFLOW=$1
+
+DIR=`mktemp -d /tmp/pdfreflow.XXXXXX` || exit 1
+SOCKET=$DIR/socket
+FIFO=$DIR/fifo
+TESTDIR=`pwd`
+mkfifo $FIFO
+
+$PDFREFLOW --server=$SOCKET -w 2 --timeout=20 2>$DIR/server.txt &
+SERVER=$!
+WRITER=
+trap 'kill $SERVER $WRITER 2>/dev/null; rm -rf $DIR' 0
+
+# wait for the socket
+TRIES=0
+while [ ! -S $SOCKET ] && [ $TRIES -lt 50 ] ; do
+	sleep 0.1
+	TRIES=`expr $TRIES + 1`
+done
+
+# client.pl concurrent SOCKET SLOWJOB JOB
+#   connects B, then A which sends SLOWJOB, then B sends JOB
+# client.pl jobs SOCKET JOB...
+#   sends the jobs on one connection
+# client.pl big SOCKET BYTES
+#   sends a request line of BYTES bytes
+# the replies of the last connection are read until its end, with a time
+# limit of 10 seconds, and its status lines are printed
+cat > $DIR/client.pl <<'EOF'
+use strict;
+use IO::Socket::UNIX;
+
+sub connectto { IO::Socket::UNIX->new(Peer => $_[0]) or die "connect: $!\n"; }
+
+# reads json lines and the chunks after them, prints the statuses
+sub readreplies {
+    my ($sock) = @_;
+    my ($buf, $data) = ("", "");
+    local $SIG{ALRM} = sub { print "failed: waited 10 seconds\n"; exit 1; };
+    alarm 10;
+    while (sysread($sock, $buf, 65536)) {
+	$data .= $buf;
+    }
+    alarm 0;
+    while ((my $end = index($data, "\n")) >= 0) {
+	if ($data =~ /^\{"chunk":(\d+)\}\n/) {
+	    $data = substr($data, length($&) + $1);
+	} else {
+	    print substr($data, 0, $end + 1);
+	    $data = substr($data, $end + 1);
+	}
+    }
+}
+
+my ($mode, $socket, @args) = @ARGV;
+my $sock = connectto($socket);
+if ($mode eq "concurrent") {
+    select(undef, undef, undef, 0.3);
+    my $a = connectto($socket);
+    print $a "$args[0]\n";
+    select(undef, undef, undef, 0.5);
+    print $sock "$args[1]\n";
+} elsif ($mode eq "jobs") {
+    print $sock "$_\n" foreach @args;
+} else {
+    # the server may stop reading before the end of the line
+    local $SIG{PIPE} = 'IGNORE';
+    my $line = '{"xml":"' . ("x" x ($args[0] - 10)) . "\"}\n";
+    syswrite($sock, $line);
+}
+shutdown($sock, 1);
+readreplies($sock);
+EOF
+
+# check NAME OUTPUT PATTERN..., every pattern is a line of OUTPUT
+check() {
+	NAME=$1
+	OUT=$2
+	shift 2
+	FAILED=
+	for PATTERN ; do
+		grep -q "$PATTERN" $OUT || FAILED=1
+	done
+	if [ -z "$FAILED" ] && ! grep -q '^failed:' $OUT ; then
+		echo "Test $NAME succeeded"
+	else
+		echo "Test $NAME failed"
+		cat $OUT
+	fi
+}
+
+JOB="{\"input\":\"$TESTDIR/test1.xml\",\"options\":[\"--showpara\"]}"
+
+echo Test concurrent pdfreflow --server -w 2
+perl $DIR/client.pl concurrent $SOCKET "{\"input\":\"$FIFO\"}" "$JOB" > $DIR/out.txt
+# let the job of A finish
+cat test1.xml > $FIFO &
+WRITER=$!
+check concurrent $DIR/out.txt '^{"status":0'
+
+echo Test options pdfreflow --server
+INPUT="\"input\":\"$TESTDIR/test1.xml\""
+perl $DIR/client.pl jobs $SOCKET \
+	"{$INPUT,\"options\":[\"--diag=$DIR/diag.txt\"]}" \
+	"{$INPUT,\"options\":[\"test2.xml\"]}" \
+	"{$INPUT,\"options\":[\"-m\",\"$DIR/manifest\"]}" \
+	"{$INPUT,\"options\":[\"--workers=4\"]}" \
+	"{$INPUT,\"options\":[\"--ragright\"]}" > $DIR/out.txt
+[ -f $DIR/diag.txt ] && echo "failed: --diag wrote a file" >> $DIR/out.txt
+check options $DIR/out.txt \
+	'^{"status":5,"log":"Option --diag can not' \
+	'^{"status":5,"log":"A server job can not name input files, test2.xml' \
+	'^{"status":5,"log":"Option --manifest can not' \
+	'^{"status":5,"log":"Option --workers can not' \
+	'^{"status":0'
+
+echo Test requestsize pdfreflow --server
+perl $DIR/client.pl big $SOCKET 67108865 > $DIR/out.txt
+check requestsize $DIR/out.txt '^{"status":2,"error":"a request is at most 67108864 bytes"}'